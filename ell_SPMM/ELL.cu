@@ -15,12 +15,17 @@
  */
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
 #include "cmdline.h"
 #include "sparse_io.h"
+#include "sparse_binary.h"
 #include "sparse_formats.h"
+#include "bfloat16.h"
 #include "test_spmm.h"
 #include "benchmark_ell.h"
 #include "spmm_ell_device.cu.h"
+#include "spmm_csb_host.h"
+#include "spmm_hilbert_host.h"
 
 template <typename IndexType, typename ValueType>
 void test_ell_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
@@ -31,6 +36,181 @@ void test_ell_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
 
 }
 
+template <typename IndexType, typename ValueType>
+void test_ell_matrix_kernel(const ell_matrix<IndexType,ValueType>& ell)
+{
+ 
+   //Test the performance of ell kernel on a prebuilt ELL matrix
+   benchmark_ell_on_device(ell, spmm_ell_device<IndexType, ValueType>,"ell");
+
+}
+
+template <typename MatrixType, typename IndexType, typename ValueType>
+void test_ell_mixed_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const char * method_name)
+{
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    ell_matrix<IndexType,ValueType> ell = csr_to_ell<IndexType,ValueType>(csr, max_cols_per_row);
+    if (ell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+       printf("Skipping ELL: the longest row has %llu entries (limit %llu)\n", (unsigned long long) ell.num_cols_per_row, (unsigned long long) max_cols_per_row);
+       return;
+    }
+    // the same ELL structure with the values rounded to MatrixType
+    ell_matrix<IndexType,MatrixType> ell_mixed = convert_ell_values<MatrixType>(ell);
+
+    //Check the accuracy of the mixed precision kernel, then time it against full precision ELL
+    test_spmm_kernel(csr, ell_mixed, spmm_ell_mixed_device<IndexType, MatrixType, ValueType, ValueType>, method_name);
+    benchmark_ell_mixed_on_device(ell, ell_mixed, spmm_ell_device<IndexType, ValueType>, spmm_ell_mixed_device<IndexType, MatrixType, ValueType, ValueType>, method_name);
+
+    delete_host_matrix(ell_mixed);
+    delete_host_matrix(ell);
+}
+
+template <typename QuantType, typename IndexType, typename ValueType>
+void test_quantized_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const char * ell_method_name, const char * csr_method_name)
+{
+
+   //Test the performance of ELL and CSR with integer values and per-row scales
+   benchmark_quantized_ell_on_device<QuantType>(csr, spmm_quantized_ell_device<IndexType, ValueType, QuantType>, ell_method_name);
+   benchmark_quantized_csr_on_device<QuantType>(csr, spmm_quantized_csr_device<IndexType, ValueType, QuantType>, csr_method_name);
+
+}
+
+template <typename IndexType, typename ValueType>
+bool test_dia_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
+{
+
+   //Test the performance of the DIA kernel, if DIA streams less than ELL
+   return benchmark_dia_on_device(csr, spmm_dia_device<IndexType, ValueType>,"dia");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_ellr_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
+{
+
+   //Test the performance of the ELL-R kernel, which stops at each row's length
+   benchmark_ellr_on_device(csr, spmm_ellr_device<IndexType, ValueType>,"ellr");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_ell16_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
+{
+
+   //Test the performance of the ELL kernel with 16-bit column offsets
+   benchmark_ell16_on_device(csr, spmm_ell16_device<IndexType, ValueType>,"ell16");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_hyb_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr)
+{
+
+   //Test the performance of HYB: ELL part and COO tail on concurrent streams
+   benchmark_hyb_on_device(csr, spmm_hyb_device<IndexType, ValueType>,"hyb");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_sell_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const IndexType sort_window)
+{
+
+   //Test the performance of the sliced ELL kernel, one warp of rows per slice
+   benchmark_sell_on_device(csr, spmm_sell_device<IndexType, ValueType>, (IndexType) 32, sort_window, "sell");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_bell_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const IndexType block_size)
+{
+
+   //Test the performance of the register-blocked block ELL kernel
+   benchmark_bell_on_device(csr, spmm_bell_device<IndexType, ValueType>, block_size, "bell");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_csb_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const IndexType beta)
+{
+
+   //Test the performance of the task-parallel CSB kernels on the host, A*X and A^T*X
+   benchmark_csb(csr, spmm_csb_host<IndexType, ValueType>, spmm_csb_transpose_host<IndexType, ValueType>, beta, "csb", "csb_transpose");
+
+}
+
+template <typename IndexType, typename ValueType>
+void test_hilbert_coo_matrix_kernel(const csr_matrix<IndexType,ValueType>& csr, const IndexType tile_size)
+{
+
+   //Test the performance of the Hilbert-ordered COO kernel on the host
+   benchmark_hilbert_coo(csr, spmm_hilbert_coo_host<IndexType, ValueType>, tile_size, "hilbert_coo");
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Benchmark a pattern matrix (all nonzeros one) with and without stored values
+// The ELL run multiplies by explicit ones; the pattern run reads no Ax at all.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void run_ell_pattern(const char * mm_filename)
+{
+    csr_pattern<IndexType> csr = read_csr_pattern<IndexType>(mm_filename);
+
+    printf("Using %llu-by-%llu pattern matrix with %llu nonzero values\n", (unsigned long long) csr.num_rows, (unsigned long long) csr.num_cols, (unsigned long long) csr.num_nonzeros); 
+
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    ell_pattern<IndexType> pattern = csr_to_ell_pattern(csr, max_cols_per_row);
+    delete_host_matrix(csr);
+    if (pattern.num_nonzeros == 0 && csr.num_nonzeros != 0)
+        return;
+
+    ell_matrix<IndexType,ValueType> ell = ell_pattern_to_ell<ValueType>(pattern);
+    test_ell_matrix_kernel(ell);
+    delete_host_matrix(ell);
+
+    benchmark_ell_pattern_on_device<ValueType>(pattern, spmm_ell_pattern_device<IndexType, ValueType>, "ell_pattern");
+    delete_host_matrix(pattern);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Benchmark ELL built straight from the COO entries, without a CSR copy
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void run_ell_direct(const char * mm_filename)
+{
+    bool symmetric = false;
+    coo_matrix<IndexType,ValueType> coo = read_coo_matrix<IndexType,ValueType>(mm_filename, &symmetric);
+
+    // the stored triangle of a symmetric matrix is mirrored during conversion
+    IndexType num_nonzeros = coo.num_nonzeros;
+    if (symmetric){
+        IndexType num_diagonals = 0;
+        #pragma omp parallel for schedule(static) reduction(+:num_diagonals)
+        for(IndexType n = 0; n < coo.num_nonzeros; n++)
+            num_diagonals += (coo.I[n] == coo.J[n]) ? 1 : 0;
+        num_nonzeros = 2 * coo.num_nonzeros - num_diagonals;
+    }
+
+    printf("Using %llu-by-%llu matrix with %llu nonzero values\n", (unsigned long long) coo.num_rows, (unsigned long long) coo.num_cols, (unsigned long long) num_nonzeros); 
+
+    // random values as in the CSR path, but drawn in COO order
+    srand(13);
+    for(IndexType i = 0; i < coo.num_nonzeros; i++){
+      coo.V[i] = 1.0 - 2.0 * (rand() / (RAND_MAX + 1.0)); 
+    }
+
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * num_nonzeros) / coo.num_rows + 1 );
+    host_timer t;
+    ell_matrix<IndexType,ValueType> ell = coo_to_ell(coo, max_cols_per_row, symmetric);
+    delete_host_matrix(coo);
+    if (ell.num_nonzeros == 0 && num_nonzeros != 0)
+        return;
+    printf("Converted COO to ELL in %.1f ms\n", t.milliseconds_elapsed());
+
+    test_ell_matrix_kernel(ell);
+    delete_host_matrix(ell);
+}
+
 template <typename IndexType, typename ValueType>
 void run_ell(int argc, char **argv)
 {
@@ -43,12 +223,113 @@ void run_ell(int argc, char **argv)
     }
     
 
+    if (!is_binary_matrix_file(mm_filename) && mm_is_pattern_file(mm_filename)){
+        run_ell_pattern<IndexType,ValueType>(mm_filename);
+        return;
+    }
+
+    char * loader = get_argval(argc, argv, "loader");
+
+    // rows sorted together by length for SELL-C-sigma
+    IndexType sort_window = 1024;
+    char * sigma_str = get_argval(argc, argv, "sigma");
+    if (sigma_str != NULL)
+        sort_window = (IndexType) std::max(1, atoi(sigma_str));
+
+    // square block size for block ELL, 0 to detect it from the matrix
+    IndexType block_size = 0;
+    char * block_str = get_argval(argc, argv, "block");
+    if (block_str != NULL){
+        const int block = atoi(block_str);
+        if (block != 0 && block != 2 && block != 3 && block != 4 && block != 6){
+            printf("Unsupported block size %d\n", block);
+            exit(1);
+        }
+        block_size = (IndexType) block;
+    }
+
+    // the host formats run instead of the other formats:
+    // --csb[=N] runs CSB with N x N blocks (0 picks the size),
+    // --hilbert[=N] runs Hilbert-ordered COO with N x N tiles
+    const bool csb_mode = get_arg(argc, argv, "csb") != NULL;
+    IndexType csb_beta = 0;
+    char * csb_str = get_argval(argc, argv, "csb");
+    if (csb_str != NULL){
+        const int beta = atoi(csb_str);
+        if (beta < 0 || beta > 65536 || (beta & (beta - 1)) != 0){
+            printf("CSB block size %d is not 0 or a power of two up to 65536\n", beta);
+            exit(1);
+        }
+        csb_beta = (IndexType) beta;
+    }
+
+    const bool hilbert_mode = get_arg(argc, argv, "hilbert") != NULL;
+    IndexType tile_size = 512;
+    char * tile_str = get_argval(argc, argv, "hilbert");
+    if (tile_str != NULL){
+        const int tile = atoi(tile_str);
+        if (tile <= 0 || (tile & (tile - 1)) != 0){
+            printf("Hilbert tile size %d is not a power of two\n", tile);
+            exit(1);
+        }
+        tile_size = (IndexType) tile;
+    }
+
+    const bool host_mode = csb_mode || hilbert_mode;
+
+    // --quantize=8|16 compares ELL with quantized ELL and CSR instead
+    int quantize_bits = 0;
+    char * quantize_str = get_argval(argc, argv, "quantize");
+    if (quantize_str != NULL)
+        quantize_bits = atoi(quantize_str);
+    if (quantize_bits != 0 && quantize_bits != 8 && quantize_bits != 16){
+        printf("Unsupported quantization to %d bits\n", quantize_bits);
+        exit(1);
+    }
+
+    // --precision=mixed|bf16 compares ELL with fp32 or bf16 values against
+    // full precision ELL only; the vectors and sums stay in ValueType
+    char * precision_str = get_argval(argc, argv, "precision");
+    const bool mixed_mode = precision_str != NULL && strcmp(precision_str, "mixed") == 0;
+    const bool bf16_mode  = precision_str != NULL && strcmp(precision_str, "bf16") == 0;
+
+    // each of these replaces the other formats, so only one can run
+    if ((mixed_mode || bf16_mode) + host_mode + (quantize_bits != 0) > 1){
+        printf("--precision=mixed|bf16, --csb/--hilbert and --quantize cannot be combined\n");
+        exit(1);
+    }
+
+    if (!is_binary_matrix_file(mm_filename) && loader != NULL && strcmp(loader, "direct") == 0){
+        run_ell_direct<IndexType,ValueType>(mm_filename);
+        return;
+    }
+
     csr_matrix<IndexType,ValueType> csr;
+    binary_matrix_file<IndexType,ValueType> bin;
+    bin.has_csr = bin.has_ell = bin.owns_csr = false;
 
-    csr= read_csr_matrix<IndexType,ValueType>(mm_filename);
+    if (is_binary_matrix_file(mm_filename)){
+        // matrix converted ahead of time by convert_mtx: map it, no parsing
+        bin = open_binary_matrix<IndexType,ValueType>(mm_filename);
+        if (!bin.has_csr){
+            printf("%s does not hold a CSR matrix\n", mm_filename);
+            exit(1);
+        }
+        csr = bin.csr;
+        // the mapping is read-only, so the random values below get their own array
+        csr.Ax = new_host_array<ValueType>(csr.num_nonzeros);
+    } else if (loader != NULL && strcmp(loader, "streaming") == 0){
+        // two passes over the file straight into CSR, no COO copy
+        csr= read_csr_matrix_streaming<IndexType,ValueType>(mm_filename);
+    } else if (loader != NULL && strcmp(loader, "pipelined") == 0){
+        // parse and count rows in one pass, then scatter into CSR
+        csr= read_csr_matrix_pipelined<IndexType,ValueType>(mm_filename);
+    } else {
+        csr= read_csr_matrix<IndexType,ValueType>(mm_filename);
+    }
             
 
-    printf("Using %d-by-%d matrix with %d nonzero values\n", csr.num_rows, csr.num_cols, csr.num_nonzeros); 
+    printf("Using %llu-by-%llu matrix with %llu nonzero values\n", (unsigned long long) csr.num_rows, (unsigned long long) csr.num_cols, (unsigned long long) csr.num_nonzeros); 
 
     // fill matrix with random values: some matrices have extreme values, 
     // which makes correctness testing difficult, especially in single precision
@@ -58,21 +339,101 @@ void run_ell(int argc, char **argv)
     }
     
     // Call the function that tests the correctness and performance of ell kernel
-    test_ell_matrix_kernel(csr);
+    if (mixed_mode){
+        test_ell_mixed_matrix_kernel<float>(csr, "ell_fp32");
+    } else if (bf16_mode){
+        test_ell_mixed_matrix_kernel<bfloat16>(csr, "ell_bf16");
+    } else if (bin.has_ell){
+        // reuse the stored ELL structure, with the same random values as csr
+        ell_matrix<IndexType,ValueType> ell = bin.ell;
+        ell.Ax = new_host_array<ValueType>(ell.stride * ell.num_cols_per_row);
+        csr_to_ell_values(csr, ell);
+        test_ell_matrix_kernel(ell);
+        delete_host_array(ell.Ax);
+    } else if (host_mode || quantize_bits != 0 || !test_dia_matrix_kernel(csr)) {
+        // banded matrices run as DIA, everything else falls back to ELL;
+        // the host and quantized formats are always compared with ELL
+        test_ell_matrix_kernel(csr);
+    }
+    if (host_mode){
+        if (csb_mode)
+            test_csb_matrix_kernel(csr, csb_beta);
+        if (hilbert_mode)
+            test_hilbert_coo_matrix_kernel(csr, tile_size);
+    } else if (quantize_bits == 8){
+        test_quantized_matrix_kernel<signed char>(csr, "ell_int8", "csr_int8");
+    } else if (quantize_bits == 16){
+        test_quantized_matrix_kernel<short>(csr, "ell_int16", "csr_int16");
+    } else if (!mixed_mode && !bf16_mode){
+        test_ellr_matrix_kernel(csr);
+        test_ell16_matrix_kernel(csr);
+        test_hyb_matrix_kernel(csr);
+        test_sell_matrix_kernel(csr, sort_window);
+        test_bell_matrix_kernel(csr, block_size);
+    }
     
-    delete_host_matrix(csr);
+    if (bin.has_csr){
+        delete_host_array(csr.Ax);
+        close_binary_matrix(bin);
+    } else {
+        delete_host_matrix(csr);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Whether the matrix in 'filename' is benchmarked with 64-bit indices
+// Binary files keep the index width they were converted with; Matrix Market
+// files use the 32-bit path unless their size requires more.
+////////////////////////////////////////////////////////////////////////////////
+bool use_64bit_indices(const char * filename)
+{
+    if (is_binary_matrix_file(filename))
+        return read_binary_matrix_header(filename).index_size == sizeof(unsigned long long);
+
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    mm_read_header(filename, matcode, num_rows, num_cols, num_nonzeros);
+    if (mm_is_symmetric(matcode))
+        num_nonzeros *= 2;
+
+    return needs_64bit_indices(num_rows, num_cols, num_nonzeros);
 }
 
 int main(int argc, char** argv)
 {
     int precision = 64;
     char * precision_str = get_argval(argc, argv, "precision");
-    if(precision_str != NULL)
-        precision = atoi(precision_str);
-    printf("\nUsing %d-bit floating point precision\n\n", precision);
+    if(precision_str != NULL && strcmp(precision_str, "mixed") == 0)
+        printf("\nUsing 32-bit matrix values with 64-bit vectors and accumulation\n\n");
+    else if(precision_str != NULL && strcmp(precision_str, "bf16") == 0)
+        printf("\nUsing bfloat16 matrix values with 64-bit vectors and accumulation\n\n");
+    else {
+        if(precision_str != NULL)
+            precision = atoi(precision_str);
+        printf("\nUsing %d-bit floating point precision\n\n", precision);
+    }
+
+    char * mm_filename = NULL;
+    for(int i = 1; i < argc; i++){
+        if(argv[i][0] != '-'){
+            mm_filename = argv[i];
+            break;
+        }
+    }
+    if (mm_filename == NULL){
+        printf("usage: %s [--precision=32|64|mixed|bf16] [--loader=streaming|pipelined|direct] [--sigma=N] [--block=0|2|3|4|6] [--csb[=N]] [--hilbert[=N]] [--quantize=8|16] matrix.mtx|matrix.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const bool wide_indices = use_64bit_indices(mm_filename);
+    if (wide_indices)
+        printf("Using 64-bit indices\n\n");
 
     if(precision ==  32){
-        run_ell<unsigned int, float>(argc,argv);
+        if (wide_indices)
+            run_ell<unsigned long long, float>(argc,argv);
+        else
+            run_ell<unsigned int, float>(argc,argv);
     }
     else if(precision == 64)
     {
@@ -82,8 +443,10 @@ int main(int argc, char** argv)
         cudaGetDeviceProperties(&properties, current_device);
         if (properties.major == 1 && properties.minor < 3)
             std::cerr << "ERROR: Support for \'double\' requires Compute Capability 1.3 or greater\n\n";
+        else if (wide_indices)
+            run_ell<unsigned long long, double>(argc,argv);
         else
-        run_ell<unsigned int, double>(argc,argv);
+            run_ell<unsigned int, double>(argc,argv);
     }
    
     return EXIT_SUCCESS;
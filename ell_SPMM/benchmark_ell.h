@@ -15,68 +15,225 @@
  */
 #pragma once
 #include <stdio.h>
+#include <vector>
 
 #include "sparse_formats.h"
+#include "spmm_host.h"
+#include "test_spmm.h"
 #include "timer.h"
  
-template <typename IndexType, typename ValueType>
-size_t bytes_per_spmv(const ell_matrix<IndexType,ValueType>& mtx)
+// A[i,j] is counted in the matrix's own storage type, which can be narrower
+// than the vectors' ValueType
+template <typename IndexType, typename ValueType, typename MatrixType>
+size_t bytes_per_spmv(const ell_matrix<IndexType,MatrixType>& mtx)
 {
 	    
     size_t bytes = 0;
     bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(MatrixType) * mtx.stride * mtx.num_cols_per_row; // A[i,j] and padding
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// row lengths instead of padding: only the used slots are read
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const ellr_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * mtx.num_rows;     // row length
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // A[i,j]
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// as ELL, with 16-bit column offsets outside the wide blocks
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const ell16_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 2*sizeof(IndexType) * mtx.num_blocks;   // base column and wide position
+    bytes += 1*sizeof(unsigned short) * (mtx.num_nonzeros - mtx.num_wide_nonzeros); // column offset
+    bytes += 1*sizeof(IndexType) * mtx.num_wide_nonzeros; // column index
     bytes += 1*sizeof(ValueType) * mtx.stride * mtx.num_cols_per_row; // A[i,j] and padding
     bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
     bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
     return bytes;
 }
-  
 
+// the ELL part as above, plus the COO tail with an atomic update of y per entry
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const hyb_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * mtx.ell.num_nonzeros; // column index
+    bytes += 1*sizeof(ValueType) * mtx.ell.stride * mtx.ell.num_cols_per_row; // A[i,j] and padding
+    bytes += 1*sizeof(ValueType) * mtx.ell.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    bytes += 2*sizeof(IndexType) * mtx.coo.num_nonzeros; // row and column index
+    bytes += 2*sizeof(ValueType) * mtx.coo.num_nonzeros; // A[i,j] and x[j]
+    bytes += 2*sizeof(ValueType) * mtx.coo.num_nonzeros; // y[i] = y[i] + ...
+    return bytes;
+}
 
-template <typename IndexType, typename ValueType, typename SpMM>
-void benchmark_ell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+// as ELL, with padding only up to the width of each slice
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const sell_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * (mtx.num_slices + 1); // slice offsets
+    bytes += 1*sizeof(IndexType) * mtx.num_rows;     // row permutation
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(ValueType) * mtx.num_entries;  // A[i,j] and padding
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// no column indices; every slot of a diagonal inside the matrix is read
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const dia_matrix<IndexType,ValueType>& mtx)
+{
+    const size_t num_slots = (size_t) mtx.num_diagonals * mtx.num_rows;
+    size_t bytes = 0;
+    bytes += sizeof(long long) * mtx.num_diagonals;  // diagonal offsets
+    bytes += 1*sizeof(ValueType) * num_slots;        // A[i,j] and fill
+    bytes += 1*sizeof(ValueType) * num_slots;        // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// one index per block, and x read once per block column instead of per nonzero
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const bell_matrix<IndexType,ValueType>& mtx)
+{
+    const size_t B = mtx.block_size;
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * mtx.stride * mtx.num_blocks_per_row;         // block column index and padding
+    bytes += 1*sizeof(ValueType) * mtx.stride * mtx.num_blocks_per_row * B * B; // A[i,j], fill and padding
+    bytes += 1*sizeof(ValueType) * mtx.num_blocks * B;     // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;           // y[i] = y[i] + ...
+    return bytes;
+}
+
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const csr_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * (mtx.num_rows + 1); // row pointer
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 2*sizeof(ValueType) * mtx.num_nonzeros; // A[i,j] and x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// a block pointer per block and two 16-bit offsets per nonzero
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const csb_matrix<IndexType,ValueType>& mtx)
+{
+    const size_t num_blocks = (size_t) mtx.num_block_rows * mtx.num_block_cols;
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * (num_blocks + 1);      // block offsets
+    bytes += 2*sizeof(unsigned short) * mtx.num_nonzeros; // row and column offset
+    bytes += 2*sizeof(ValueType) * mtx.num_nonzeros;      // A[i,j] and x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;          // y[i] = y[i] + ...
+    return bytes;
+}
+
+// as COO; y is read and written once per row of every tile a thread visits,
+// approximated here by once per row
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const hilbert_coo_matrix<IndexType,ValueType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 2*sizeof(IndexType) * mtx.num_nonzeros; // row and column index
+    bytes += 2*sizeof(ValueType) * mtx.num_nonzeros; // A[i,j] and x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+
+// integer values plus one scale per row
+template <typename IndexType, typename ValueType, typename QuantType>
+size_t bytes_per_spmv(const quantized_ell_matrix<IndexType,ValueType,QuantType>& mtx)
 {
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(QuantType) * mtx.stride * mtx.num_cols_per_row; // A[i,j] and padding
+    bytes += 1*sizeof(ValueType) * mtx.num_rows;     // row scale
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
 
+template <typename IndexType, typename ValueType, typename QuantType>
+size_t bytes_per_spmv(const quantized_csr_matrix<IndexType,ValueType,QuantType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * (mtx.num_rows + 1); // row pointer
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(QuantType) * mtx.num_nonzeros; // A[i,j]
+    bytes += 1*sizeof(ValueType) * mtx.num_rows;     // row scale
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
 
-    for (int NUMVECTORS=2; NUMVECTORS<=32; NUMVECTORS*=2){
+// a pattern matrix streams the same column indices, but no A[i,j]
+template <typename IndexType, typename ValueType>
+size_t bytes_per_spmv(const ell_pattern<IndexType>& mtx)
+{
+    size_t bytes = 0;
+    bytes += 1*sizeof(IndexType) * mtx.num_nonzeros; // column index
+    bytes += 1*sizeof(ValueType) * mtx.num_nonzeros; // x[j]
+    bytes += 2*sizeof(ValueType) * mtx.num_rows;     // y[i] = y[i] + ...
+    return bytes;
+}
+  
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time 'spmm' on a matrix copied to the device, for 2 to MAX_NUMVECTORS vectors
+// Works for any matrix type with a copy_matrix_to_device, delete_device_matrix
+// and bytes_per_spmv<IndexType,ValueType> overload.  Returns the time per
+// SpMM in ms for 2, 4, ... vectors.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename Matrix, typename SpMM>
+std::vector<double> benchmark_spmm(const Matrix& ell, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    Matrix ell_device = copy_matrix_to_device(ell);
+    std::vector<double> msec;
+
+    for (int NUMVECTORS=2; NUMVECTORS<=MAX_NUMVECTORS; NUMVECTORS*=2){
 
     // initialize host vectors
-    ValueType * x_host = new_host_array<ValueType>(csr.num_cols* NUMVECTORS);
+    ValueType * x_host = new_host_array<ValueType>(ell.num_cols* NUMVECTORS);
 
      for(IndexType j = 0; j < NUMVECTORS ; j++)
-	 for(IndexType i = 0; i < csr.num_cols; i++)
-       	 x_host[j*csr.num_cols+i] = rand() / (RAND_MAX + 1.0);
+	 for(IndexType i = 0; i < ell.num_cols; i++)
+       	 x_host[j*ell.num_cols+i] = rand() / (RAND_MAX + 1.0);
 
-    ValueType * y_host = new_host_array<ValueType>(csr.num_rows*NUMVECTORS);
-    std::fill(y_host, y_host + csr.num_rows*NUMVECTORS, 0);
-    ell_matrix<IndexType,ValueType> ell_device ;
-    ell_matrix<IndexType,ValueType> ell;
+    ValueType * y_host = new_host_array<ValueType>(ell.num_rows*NUMVECTORS);
+    std::fill(y_host, y_host + ell.num_rows*NUMVECTORS, 0);
     //initialize device arrays
     
-    ValueType * y_loc = copy_array(y_host, csr.num_rows*NUMVECTORS, HOST_MEMORY, loc);
-    ValueType * x_loc = copy_array(x_host, csr.num_cols*NUMVECTORS , HOST_MEMORY, loc);
+    ValueType * y_loc = copy_array(y_host, ell.num_rows*NUMVECTORS, HOST_MEMORY, loc);
+    ValueType * x_loc = copy_array(x_host, ell.num_cols*NUMVECTORS , HOST_MEMORY, loc);
 
-    printf("###   Testing the performance of SpMM using ELL   ###\n");
+    printf("###   Testing the performance of SpMM using %s   ###\n", method_name);
     printf("Number of dense vectors %d   \n", NUMVECTORS);
     size_t num_iterations = max_iterations;
 
-	
-    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
-    ell = csr_to_ell<IndexType,ValueType>(csr, max_cols_per_row);
-    if (ell.num_nonzeros == 0 && csr.num_nonzeros != 0){
-       return;
-    }
-
-    ell_device= copy_matrix_to_device(ell);
-
     timer t;
     for(size_t i = 0; i < num_iterations; i++)
         spmm(ell_device, x_loc, y_loc, NUMVECTORS, NUMVECTORS);
     cudaThreadSynchronize();
     double msec_per_iteration = t.milliseconds_elapsed() / (double) num_iterations;
+    msec.push_back(msec_per_iteration);
     double sec_per_iteration = msec_per_iteration / 1000.0;
     double GFLOPs = (sec_per_iteration == 0) ? 0 : (NUMVECTORS *2.0 * (double) ell.num_nonzeros / sec_per_iteration) / 1e9;
-	double GBYTEs = (sec_per_iteration == 0) ? 0 : ((double) bytes_per_spmv(ell) / sec_per_iteration) / 1e9;
+	double GBYTEs = (sec_per_iteration == 0) ? 0 : ((double) bytes_per_spmv<IndexType,ValueType>(ell) / sec_per_iteration) / 1e9;
 	
 	
     const char * location = (loc == HOST_MEMORY) ? "cpu" : "gpu";
@@ -88,8 +245,6 @@ void benchmark_ell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const
 			
 			
 			
-    delete_device_matrix(ell_device);
-    delete_host_matrix(ell);
     delete_host_array(y_host);
     delete_host_array(x_host);
     delete_array(y_loc, loc);
@@ -97,6 +252,363 @@ void benchmark_ell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const
 
 }
 
+    delete_device_matrix(ell_device);
+
+    return msec;
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ell(const ell_matrix<IndexType,ValueType>& ell, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    benchmark_spmm<IndexType,ValueType>(ell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+}
+
+template <typename ValueType, typename IndexType, typename SpMM>
+void benchmark_ell_pattern(const ell_pattern<IndexType>& ell, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    // Ax (with its padding) is the traffic a pattern matrix does not stream
+    const double saved_bytes = (double) sizeof(ValueType) * ell.stride * ell.num_cols_per_row;
+    const double ell_bytes   = (double) bytes_per_spmv<IndexType,ValueType>(ell) + saved_bytes;
+    printf("Pattern ELL skips %.1f MB of values per SpMM (%.1f%% of the ELL traffic)\n",
+           saved_bytes / 1e6, (ell_bytes == 0) ? 0.0 : 100.0 * saved_bytes / ell_bytes);
+
+    benchmark_spmm<IndexType,ValueType>(ell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+}
+
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    host_timer t;
+    ell_matrix<IndexType,ValueType> ell = csr_to_ell<IndexType,ValueType>(csr, max_cols_per_row);
+    if (ell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+       printf("Skipping ELL: the longest row has %llu entries (limit %llu)\n", (unsigned long long) ell.num_cols_per_row, (unsigned long long) max_cols_per_row);
+       return;
+    }
+    printf("Converted CSR to ELL in %.1f ms\n", t.milliseconds_elapsed());
+
+    benchmark_ell(ell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(ell);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time ELL with full precision values against the same matrix stored in MatrixType
+// Both runs use ValueType vectors; the speedup of the narrower values is
+// printed for every number of vectors.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename MatrixType, typename SpMM, typename SpMMMixed>
+void benchmark_ell_mixed(const ell_matrix<IndexType,ValueType>& ell, const ell_matrix<IndexType,MatrixType>& ell_mixed, SpMM spmm, SpMMMixed spmm_mixed, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    const double ell_bytes   = (double) bytes_per_spmv<IndexType,ValueType>(ell);
+    const double saved_bytes = ell_bytes - (double) bytes_per_spmv<IndexType,ValueType>(ell_mixed);
+    printf("%d-byte matrix values save %.1f MB per SpMM (%.1f%% of the ELL traffic)\n",
+           (int) sizeof(MatrixType), saved_bytes / 1e6, (ell_bytes == 0) ? 0.0 : 100.0 * saved_bytes / ell_bytes);
+
+    const std::vector<double> msec       = benchmark_spmm<IndexType,ValueType>(ell, spmm, loc, "ell", min_iterations, max_iterations, seconds);
+    const std::vector<double> msec_mixed = benchmark_spmm<IndexType,ValueType>(ell_mixed, spmm_mixed, loc, method_name, min_iterations, max_iterations, seconds);
+
+    for (size_t n = 0, NUMVECTORS = 2; n < msec.size(); n++, NUMVECTORS *= 2)
+        printf("\t%-20s speedup over ell with %2d vectors: %5.2fx\n",
+               method_name, (int) NUMVECTORS, (msec_mixed[n] == 0) ? 0.0 : msec[n] / msec_mixed[n]);
+}
+
+template <typename QuantType, typename IndexType, typename ValueType, typename SpMM>
+void benchmark_quantized_ell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    ValueType max_error;
+    quantized_ell_matrix<IndexType,ValueType,QuantType> qell = csr_to_quantized_ell<QuantType>(csr, max_cols_per_row, &max_error);
+    if (qell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+       delete_host_matrix(qell);
+       return;
+    }
+
+    // values and row scales, against the values of ELL in ValueType
+    const double ell_value_bytes = (double) sizeof(ValueType) * qell.stride * qell.num_cols_per_row;
+    const double value_bytes     = (double) sizeof(QuantType) * qell.stride * qell.num_cols_per_row + (double) sizeof(ValueType) * qell.num_rows;
+    printf("Quantized ELL with %d-bit values: largest rounding error %.2e of the row maximum, values stream %.1f MB instead of %.1f MB per SpMM (%.1fx less)\n",
+           (int) (8 * sizeof(QuantType)), (double) max_error, value_bytes / 1e6, ell_value_bytes / 1e6,
+           (value_bytes == 0) ? 0.0 : ell_value_bytes / value_bytes);
+
+    // checked against CSR with the same rounded values, so only the kernel's own error shows
+    quantized_csr_matrix<IndexType,ValueType,QuantType> qcsr = csr_to_quantized_csr<QuantType>(csr);
+    csr_matrix<IndexType,ValueType> csr_rounded = quantized_csr_to_csr(qcsr);
+    delete_host_matrix(qcsr);
+    test_spmm_kernel(csr_rounded, qell, spmm, method_name);
+    delete_host_matrix(csr_rounded);
+
+    benchmark_spmm<IndexType,ValueType>(qell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(qell);
+}
+
+template <typename QuantType, typename IndexType, typename ValueType, typename SpMM>
+void benchmark_quantized_csr(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    ValueType max_error;
+    quantized_csr_matrix<IndexType,ValueType,QuantType> qcsr = csr_to_quantized_csr<QuantType>(csr, &max_error);
+
+    const double csr_value_bytes = (double) sizeof(ValueType) * qcsr.num_nonzeros;
+    const double value_bytes     = (double) sizeof(QuantType) * qcsr.num_nonzeros + (double) sizeof(ValueType) * qcsr.num_rows;
+    printf("Quantized CSR with %d-bit values: largest rounding error %.2e of the row maximum, values stream %.1f MB instead of %.1f MB per SpMM (%.1fx less)\n",
+           (int) (8 * sizeof(QuantType)), (double) max_error, value_bytes / 1e6, csr_value_bytes / 1e6,
+           (value_bytes == 0) ? 0.0 : csr_value_bytes / value_bytes);
+
+    // checked against CSR with the same rounded values, so only the kernel's own error shows
+    csr_matrix<IndexType,ValueType> csr_rounded = quantized_csr_to_csr(qcsr);
+    test_spmm_kernel(csr_rounded, qcsr, spmm, method_name);
+    delete_host_matrix(csr_rounded);
+
+    benchmark_spmm<IndexType,ValueType>(qcsr, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(qcsr);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ellr(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    ellr_matrix<IndexType,ValueType> ellr = csr_to_ellr<IndexType,ValueType>(csr, max_cols_per_row);
+    if (ellr.num_nonzeros == 0 && csr.num_nonzeros != 0){
+       return;
+    }
+
+    // the padded values ELL streams, less the row lengths ELL-R reads instead
+    const double ell_bytes   = (double) bytes_per_spmv<IndexType,ValueType>(static_cast< const ell_matrix<IndexType,ValueType>& >(ellr));
+    const double saved_bytes = ell_bytes - (double) bytes_per_spmv<IndexType,ValueType>(ellr);
+    const double padding     = (double) ellr.stride * ellr.num_cols_per_row - ellr.num_nonzeros;
+    printf("ELL-R skips %.1f MB of padding per SpMM (%.1f%% of the ELL traffic, %.1f%% of the slots are padding)\n",
+           saved_bytes / 1e6, (ell_bytes == 0) ? 0.0 : 100.0 * saved_bytes / ell_bytes,
+           (padding == 0) ? 0.0 : 100.0 * padding / ((double) ellr.stride * ellr.num_cols_per_row));
+
+    test_spmm_kernel(csr, ellr, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(ellr, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(ellr);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ell16(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+    ell16_matrix<IndexType,ValueType> ell16 = csr_to_ell16<IndexType,ValueType>(csr, max_cols_per_row);
+    if (ell16.num_nonzeros == 0 && csr.num_nonzeros != 0){
+       delete_host_matrix(ell16);
+       return;
+    }
+
+    // the same matrix with a full column index per nonzero
+    ell_matrix<IndexType,ValueType> ell;
+    ell.num_rows = ell16.num_rows;  ell.num_cols = ell16.num_cols;  ell.num_nonzeros = ell16.num_nonzeros;
+    ell.stride = ell16.stride;  ell.num_cols_per_row = ell16.num_cols_per_row;
+    const double ell_bytes   = (double) bytes_per_spmv<IndexType,ValueType>(ell);
+    const double saved_bytes = ell_bytes - (double) bytes_per_spmv<IndexType,ValueType>(ell16);
+    printf("ELL16 keeps %llu of %llu row blocks in 16-bit offsets and saves %.1f MB per SpMM (%.1f%% of the ELL traffic)\n",
+           (unsigned long long) (ell16.num_blocks - ell16.num_wide_blocks), (unsigned long long) ell16.num_blocks,
+           saved_bytes / 1e6, (ell_bytes == 0) ? 0.0 : 100.0 * saved_bytes / ell_bytes);
+
+    test_spmm_kernel(csr, ell16, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(ell16, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(ell16);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_hyb(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    const IndexType num_cols_per_row = compute_hyb_cols_per_row(csr);
+    hyb_matrix<IndexType,ValueType> hyb = csr_to_hyb(csr, num_cols_per_row);
+    printf("HYB keeps %llu columns per row in ELL and %llu of %llu nonzeros (%.1f%%) in COO\n",
+           (unsigned long long) num_cols_per_row, (unsigned long long) hyb.coo.num_nonzeros, (unsigned long long) csr.num_nonzeros,
+           (csr.num_nonzeros == 0) ? 0.0 : 100.0 * hyb.coo.num_nonzeros / csr.num_nonzeros);
+
+    test_spmm_kernel(csr, hyb, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(hyb, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(hyb);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_sell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const IndexType slice_size, const IndexType sort_window, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    host_timer t;
+    sell_matrix<IndexType,ValueType> sell = csr_to_sell(csr, slice_size, sort_window);
+    if (sell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+        printf("Skipping SELL: the padded slices would not fit %d-bit indices\n", (int) (8 * sizeof(IndexType)));
+        return;
+    }
+    printf("Converted CSR to SELL-%llu-%llu in %.1f ms\n", (unsigned long long) slice_size, (unsigned long long) sort_window, t.milliseconds_elapsed());
+
+    // ELL pads every row to the longest one, in a 16-row aligned stride
+    const double ell_entries  = (double) csr_max_row_length(csr.num_rows, csr.Ap) * (16 * ((csr.num_rows + 15) / 16));
+    const double sell_entries = (double) sell.num_entries;
+    printf("SELL stores %.0f entries for %llu nonzeros (%.1f%% padding, ELL would store %.0f)\n",
+           sell_entries, (unsigned long long) csr.num_nonzeros,
+           (sell_entries == 0) ? 0.0 : 100.0 * (sell_entries - csr.num_nonzeros) / sell_entries, ell_entries);
+
+    test_spmm_kernel(csr, sell, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(sell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(sell);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Benchmark DIA when it streams less than ELL would
+// DIA stores one value per diagonal slot, ELL a value and an index per slot
+// of the longest row; beyond the break-even number of diagonals the fill
+// costs more than the indices save.  Returns false if DIA was not run.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename SpMM>
+bool benchmark_dia(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    const unsigned long long ell_width = csr_max_row_length(csr.num_rows, csr.Ap);
+    const IndexType max_diagonals = static_cast<IndexType>( ell_width * (sizeof(ValueType) + sizeof(IndexType)) / sizeof(ValueType) );
+
+    host_timer t;
+    dia_matrix<IndexType,ValueType> dia = csr_to_dia(csr, max_diagonals);
+    if (dia.num_nonzeros == 0 && csr.num_nonzeros != 0){
+        printf("Skipping DIA: more than %llu diagonals would stream more than ELL\n", (unsigned long long) max_diagonals);
+        return false;
+    }
+    printf("Converted CSR to DIA in %.1f ms\n", t.milliseconds_elapsed());
+
+    const double dia_slots = (double) dia.num_diagonals * dia.num_rows;
+    printf("DIA stores %llu diagonals for %llu nonzeros (%.1f%% fill)\n",
+           (unsigned long long) dia.num_diagonals, (unsigned long long) csr.num_nonzeros,
+           (dia_slots == 0) ? 0.0 : 100.0 * csr.num_nonzeros / dia_slots);
+
+    test_spmm_kernel(csr, dia, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(dia, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(dia);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time host 'spmm' on a host matrix, for 2 to MAX_NUMVECTORS vectors
+// There is no copy to the device.  x and y are sized for the larger matrix
+// dimension, so 'spmm' may also be a transposed product.  The number of
+// iterations is chosen from one untimed run to take about 'seconds'.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename Matrix, typename SpMM>
+void benchmark_spmm_host(const Matrix& mtx, SpMM spmm, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    const IndexType length = std::max(mtx.num_rows, mtx.num_cols);
+
+    for (int NUMVECTORS=2; NUMVECTORS<=MAX_NUMVECTORS; NUMVECTORS*=2){
+
+    ValueType * x = new_host_array<ValueType>((size_t) length * NUMVECTORS);
+    ValueType * y = new_host_array<ValueType>((size_t) length * NUMVECTORS);
+    for(size_t i = 0; i < (size_t) length * NUMVECTORS; i++)
+        x[i] = rand() / (RAND_MAX + 1.0);
+    std::fill(y, y + (size_t) length * NUMVECTORS, 0);
+
+    printf("###   Testing the performance of SpMM using %s on the host   ###\n", method_name);
+    printf("Number of dense vectors %d   \n", NUMVECTORS);
+
+    host_timer warmup;
+    spmm(mtx, x, y, (IndexType) NUMVECTORS);
+    const double warmup_seconds = warmup.seconds_elapsed();
+
+    size_t num_iterations = (warmup_seconds == 0) ? max_iterations : (size_t) (seconds / warmup_seconds);
+    num_iterations = std::min(max_iterations, std::max(min_iterations, num_iterations));
+
+    host_timer t;
+    for(size_t i = 0; i < num_iterations; i++)
+        spmm(mtx, x, y, (IndexType) NUMVECTORS);
+    double msec_per_iteration = t.milliseconds_elapsed() / (double) num_iterations;
+    double sec_per_iteration = msec_per_iteration / 1000.0;
+    double GFLOPs = (sec_per_iteration == 0) ? 0 : (NUMVECTORS *2.0 * (double) mtx.num_nonzeros / sec_per_iteration) / 1e9;
+    double GBYTEs = (sec_per_iteration == 0) ? 0 : ((double) bytes_per_spmv<IndexType,ValueType>(mtx) / sec_per_iteration) / 1e9;
+
+    printf("\tbenchmarking %-20s [cpu]: %8.4f ms ( %5.2f GFLOP/s)\n", method_name, msec_per_iteration, GFLOPs);
+    printf("\tbenchmarking %-20s [cpu]: ( %5.2f Gbytes/s)\n", method_name, GBYTEs);
+
+    delete_host_array(x);
+    delete_host_array(y);
+
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Time host SpMM on a CSB matrix, Y += A*X and Y += A^T*X
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename SpMM, typename SpMMTranspose>
+void benchmark_csb(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, SpMMTranspose spmm_transpose, const IndexType beta, const char * method_name, const char * transpose_method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    host_timer t;
+    csb_matrix<IndexType,ValueType> csb = csr_to_csb(csr, beta);
+    if (csb.num_nonzeros == 0 && csr.num_nonzeros != 0){
+        printf("Skipping CSB: %llux%llu blocks would outnumber the matrix entries\n", (unsigned long long) csb.beta, (unsigned long long) csb.beta);
+        return;
+    }
+    printf("Converted CSR to CSB with %llux%llu blocks in %.1f ms\n", (unsigned long long) csb.beta, (unsigned long long) csb.beta, t.milliseconds_elapsed());
+
+    // ELL pads every row to the longest one, in a 16-row aligned stride
+    const double ell_bytes = (double) csr_max_row_length(csr.num_rows, csr.Ap) * (16 * ((csr.num_rows + 15) / 16)) * (sizeof(IndexType) + sizeof(ValueType));
+    const double csb_bytes = (double) sizeof(IndexType) * ((size_t) csb.num_block_rows * csb.num_block_cols + 1)
+                           + (double) (2 * sizeof(unsigned short) + sizeof(ValueType)) * csb.num_nonzeros;
+    printf("CSB stores %.1f MB, ELL would store %.1f MB\n", csb_bytes / 1e6, ell_bytes / 1e6);
+
+    // the times to beat: CSR SpMM on the same host threads
+    benchmark_spmm_host<IndexType,ValueType>(csr, spmm_csr_host<IndexType,ValueType>, "csr_host", min_iterations, max_iterations, seconds);
+    benchmark_spmm_host<IndexType,ValueType>(csb, spmm, method_name, min_iterations, max_iterations, seconds);
+    benchmark_spmm_host<IndexType,ValueType>(csb, spmm_transpose, transpose_method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(csb);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_hilbert_coo(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const IndexType tile_size, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    host_timer t;
+    hilbert_coo_matrix<IndexType,ValueType> coo = csr_to_hilbert_coo(csr, tile_size);
+    printf("Converted CSR to Hilbert-ordered COO in %.1f ms\n", t.milliseconds_elapsed());
+    printf("Hilbert COO walks %llu tiles of %llux%llu, %.1f nonzeros per tile\n",
+           (unsigned long long) coo.num_tiles, (unsigned long long) tile_size, (unsigned long long) tile_size,
+           (coo.num_tiles == 0) ? 0.0 : (double) coo.num_nonzeros / coo.num_tiles);
+
+    benchmark_spmm_host<IndexType,ValueType>(coo, spmm, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(coo);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_bell(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, IndexType block_size, const memory_location loc, const char * method_name, const size_t min_iterations = 1, const size_t max_iterations = 1000, const double seconds = 3.0)
+{
+    // 0 picks the block size with the least matrix traffic
+    if (block_size == 0)
+        block_size = detect_block_size(csr);
+    if (block_size == 1){
+        printf("Skipping block ELL: no block size saves traffic over scalar ELL\n");
+        return;
+    }
+
+    host_timer t;
+    bcsr_matrix<IndexType,ValueType> bcsr = csr_to_bcsr(csr, block_size);
+    const IndexType num_block_rows = bcsr.num_block_rows;
+    const IndexType max_blocks_per_row = static_cast<IndexType>( (3 * bcsr.num_blocks) / std::max(num_block_rows, (IndexType) 1) + 1 );
+    bell_matrix<IndexType,ValueType> bell = bcsr_to_bell(bcsr, max_blocks_per_row);
+    delete_host_matrix(bcsr);
+    if (bell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+        printf("Skipping block ELL: a block row has more than %llu blocks\n", (unsigned long long) max_blocks_per_row);
+        return;
+    }
+    printf("Converted CSR to %llux%llu block ELL in %.1f ms\n", (unsigned long long) block_size, (unsigned long long) block_size, t.milliseconds_elapsed());
+
+    const double block_entries = (double) bell.num_blocks * block_size * block_size;
+    printf("Block ELL stores %llu blocks for %llu nonzeros (%.1f%% fill), %.1f MB of indices instead of %.1f MB\n",
+           (unsigned long long) bell.num_blocks, (unsigned long long) csr.num_nonzeros,
+           (block_entries == 0) ? 0.0 : 100.0 * csr.num_nonzeros / block_entries,
+           (double) sizeof(IndexType) * bell.num_blocks / 1e6, (double) sizeof(IndexType) * csr.num_nonzeros / 1e6);
+
+    test_spmm_kernel(csr, bell, spmm, method_name);
+    benchmark_spmm<IndexType,ValueType>(bell, spmm, loc, method_name, min_iterations, max_iterations, seconds);
+
+    delete_host_matrix(bell);
 }
 
 
@@ -106,3 +618,69 @@ void benchmark_ell_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM sp
     benchmark_ell<IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
 }
 
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ell_on_device(const ell_matrix<IndexType,ValueType>& ell, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_ell<IndexType,ValueType,SpMM>(ell, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename MatrixType, typename SpMM, typename SpMMMixed>
+void benchmark_ell_mixed_on_device(const ell_matrix<IndexType,ValueType>& ell, const ell_matrix<IndexType,MatrixType>& ell_mixed, SpMM spmm, SpMMMixed spmm_mixed, const char * method_name = NULL)
+{
+    benchmark_ell_mixed<IndexType,ValueType,MatrixType,SpMM,SpMMMixed>(ell, ell_mixed, spmm, spmm_mixed, DEVICE_MEMORY, method_name);
+}
+
+template <typename QuantType, typename IndexType, typename ValueType, typename SpMM>
+void benchmark_quantized_ell_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_quantized_ell<QuantType,IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename QuantType, typename IndexType, typename ValueType, typename SpMM>
+void benchmark_quantized_csr_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_quantized_csr<QuantType,IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ellr_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_ellr<IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_ell16_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_ell16<IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_hyb_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_hyb<IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_sell_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const IndexType slice_size, const IndexType sort_window, const char * method_name = NULL)
+{
+    benchmark_sell<IndexType,ValueType,SpMM>(csr, spmm, slice_size, sort_window, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+bool benchmark_dia_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const char * method_name = NULL)
+{
+    return benchmark_dia<IndexType,ValueType,SpMM>(csr, spmm, DEVICE_MEMORY, method_name);
+}
+
+template <typename IndexType, typename ValueType, typename SpMM>
+void benchmark_bell_on_device(const csr_matrix<IndexType,ValueType>& csr, SpMM spmm, const IndexType block_size, const char * method_name = NULL)
+{
+    benchmark_bell<IndexType,ValueType,SpMM>(csr, spmm, block_size, DEVICE_MEMORY, method_name);
+}
+
+template <typename ValueType, typename IndexType, typename SpMM>
+void benchmark_ell_pattern_on_device(const ell_pattern<IndexType>& ell, SpMM spmm, const char * method_name = NULL)
+{
+    benchmark_ell_pattern<ValueType,IndexType,SpMM>(ell, spmm, DEVICE_MEMORY, method_name);
+}
+
@@ -0,0 +1,50 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include <cuda.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//! bfloat16: the upper 16 bits of an IEEE single precision number
+// Used only to store matrix values; it converts to float for arithmetic, on
+// the host and on the device, so it needs no CUDA 11 bfloat16 support.
+// Conversion from float rounds to nearest even.
+////////////////////////////////////////////////////////////////////////////////
+struct bfloat16
+{
+    unsigned short bits;
+
+    __host__ __device__ bfloat16() {}
+
+    __host__ __device__ bfloat16(const float f)
+    {
+        union { float f; unsigned int u; } v;
+        v.f = f;
+        if ((v.u & 0x7fffffff) > 0x7f800000)
+            bits = (unsigned short) ((v.u >> 16) | 0x0040);   // keep NaN a quiet NaN
+        else
+            bits = (unsigned short) ((v.u + 0x7fff + ((v.u >> 16) & 1)) >> 16);
+    }
+
+    __host__ __device__ bfloat16(const double d) : bits(bfloat16((float) d).bits) {}
+
+    __host__ __device__ operator float() const
+    {
+        union { float f; unsigned int u; } v;
+        v.u = ((unsigned int) bits) << 16;
+        return v.f;
+    }
+};
@@ -0,0 +1,113 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// Convert a Matrix Market file into the binary container read by ell_SpMM
+//
+// usage: convert_mtx [--precision=32|64] [--format=csr|ell|both] [--compress] input.mtx output.bin
+
+#include <stdio.h>
+#include <string.h>
+#include "cmdline.h"
+#include "sparse_io.h"
+#include "sparse_binary.h"
+#include "sparse_formats.h"
+
+template <typename IndexType, typename ValueType>
+void convert(const char * mm_filename, const char * bin_filename, const char * format, const bool compress)
+{
+    const bool write_csr = strcmp(format, "csr") == 0 || strcmp(format, "both") == 0;
+    bool write_ell       = strcmp(format, "ell") == 0 || strcmp(format, "both") == 0;
+
+    if (!write_csr && !write_ell){
+        printf("Unknown format '%s' (expected csr, ell or both)\n", format);
+        exit(1);
+    }
+
+    csr_matrix<IndexType,ValueType> csr = read_csr_matrix<IndexType,ValueType>(mm_filename);
+    printf("Using %llu-by-%llu matrix with %llu nonzero values\n", (unsigned long long) csr.num_rows, (unsigned long long) csr.num_cols, (unsigned long long) csr.num_nonzeros);
+
+    ell_matrix<IndexType,ValueType> ell;
+    if (write_ell){
+        // same limit the benchmark applies before giving up on ELL
+        IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );
+        ell = csr_to_ell<IndexType,ValueType>(csr, max_cols_per_row);
+        if (ell.num_nonzeros == 0 && csr.num_nonzeros != 0){
+            printf("num_cols_per_row (%llu) exceeds limit (%llu), ELL part not written\n", (unsigned long long) ell.num_cols_per_row, (unsigned long long) max_cols_per_row);
+            write_ell = false;
+            if (!write_csr)
+                exit(1);
+        }
+    }
+
+    printf("Writing binary matrix to file (%s):", bin_filename);
+    fflush(stdout);
+    write_binary_matrix(bin_filename, write_csr ? &csr : NULL, write_ell ? &ell : NULL, compress);
+    printf(" done\n");
+
+    if (write_ell)
+        delete_host_matrix(ell);
+    delete_host_matrix(csr);
+}
+
+int main(int argc, char** argv)
+{
+    char * filenames[2] = {NULL, NULL};
+    for(int i = 1, n = 0; i < argc && n < 2; i++){
+        if(argv[i][0] != '-')
+            filenames[n++] = argv[i];
+    }
+
+    if (filenames[1] == NULL){
+        printf("usage: %s [--precision=32|64] [--format=csr|ell|both] [--compress] input.mtx output.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int precision = 64;
+    char * precision_str = get_argval(argc, argv, "precision");
+    if(precision_str != NULL)
+        precision = atoi(precision_str);
+
+    const char * format = "both";
+    char * format_str = get_argval(argc, argv, "format");
+    if(format_str != NULL)
+        format = format_str;
+
+    // delta/varint encode the CSR part (the ELL part is always stored raw)
+    const bool compress = get_arg(argc, argv, "compress") != NULL;
+
+    // 32-bit indices unless the matrix is too large for them
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    mm_read_header(filenames[0], matcode, num_rows, num_cols, num_nonzeros);
+    if (mm_is_symmetric(matcode))
+        num_nonzeros *= 2;
+    const bool wide_indices = needs_64bit_indices(num_rows, num_cols, num_nonzeros);
+
+    if(precision == 32 && wide_indices)
+        convert<unsigned long long, float>(filenames[0], filenames[1], format, compress);
+    else if(precision == 32)
+        convert<unsigned int, float>(filenames[0], filenames[1], format, compress);
+    else if(precision == 64 && wide_indices)
+        convert<unsigned long long, double>(filenames[0], filenames[1], format, compress);
+    else if(precision == 64)
+        convert<unsigned int, double>(filenames[0], filenames[1], format, compress);
+    else {
+        printf("Unsupported precision %d\n", precision);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+// Streaming decompression of gzip-compressed inputs (.mtx.gz and .tar.gz)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <zlib.h>
+
+#define TAR_BLOCK_SIZE 512
+
+// true if the file starts with the gzip magic bytes
+bool is_gzip_file(const char * filename)
+{
+    FILE * fid = fopen(filename, "rb");
+    if (fid == NULL)
+        return false;
+
+    unsigned char magic[2];
+    const bool gzip = fread(magic, 1, 2, fid) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    fclose(fid);
+
+    return gzip;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decompress a gzip file on a background thread, one block at a time
+// The producer thread inflates up to 'max_queued' blocks ahead of the
+// consumer, so decompression overlaps with whatever the consumer does with
+// the previous block (e.g. parsing it on the other cores).
+// If the decompressed data is a tar archive, only the matrix member is
+// returned: 'name/name.mtx' as in SuiteSparse archives, or the first .mtx
+// file at the top level of the archive.
+////////////////////////////////////////////////////////////////////////////////
+class gzip_block_reader
+{
+    gzFile file;
+    const size_t block_size;
+    const size_t max_queued;
+
+    std::thread producer;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque< std::vector<char> > queue;
+    bool finished;      //the producer has queued its last block
+    bool stopped;       //the consumer does not want any more blocks
+    std::string error;
+
+    // read up to 'size' decompressed bytes; fewer only at the end of the stream
+    bool read_bytes(char * data, const size_t size, size_t& num_read)
+    {
+        num_read = 0;
+        while (num_read < size){
+            const int n = gzread(file, data + num_read, (unsigned int) (size - num_read));
+            if (n < 0){
+                int errnum;
+                fail(std::string("decompression failed: ") + gzerror(file, &errnum));
+                return false;
+            }
+            if (n == 0)
+                break;
+            num_read += n;
+        }
+        return true;
+    }
+
+    void fail(const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = message;
+    }
+
+    void finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        changed.notify_all();
+    }
+
+    // hand a block to the consumer, waiting while the queue is full
+    bool push(std::vector<char>& block)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.size() >= max_queued && !stopped)
+            changed.wait(lock);
+        if (stopped)
+            return false;
+        queue.push_back(std::vector<char>());
+        queue.back().swap(block);
+        changed.notify_all();
+        return true;
+    }
+
+    static bool is_tar_header(const char * header)
+    {
+        return memcmp(header + 257, "ustar", 5) == 0;
+    }
+
+    static unsigned long long tar_member_size(const char * header)
+    {
+        unsigned long long size = 0;
+        for (int i = 124; i < 124 + 12 && header[i] >= '0' && header[i] <= '7'; i++)
+            size = 8 * size + (header[i] - '0');
+        return size;
+    }
+
+    // 'dir/dir.mtx' (the SuiteSparse layout) or a .mtx file outside any directory
+    static bool is_matrix_member(std::string path)
+    {
+        while (path.compare(0, 2, "./") == 0)
+            path.erase(0, 2);
+
+        if (path.size() < 4 || path.compare(path.size() - 4, 4, ".mtx") != 0)
+            return false;
+
+        const size_t slash = path.rfind('/');
+        if (slash == std::string::npos)
+            return true;
+
+        const size_t dir_start = (slash == 0) ? 0 : path.rfind('/', slash - 1) + 1;
+        const std::string dir = path.substr(dir_start, slash - dir_start);
+        return path.substr(slash + 1) == dir + ".mtx";
+    }
+
+    // skip tar members up to the matrix; 'header' holds the first header
+    bool seek_tar_member(std::vector<char>& header, unsigned long long& member_size)
+    {
+        std::vector<char> scratch(1 << 16);
+        std::string long_name;
+
+        for (;;){
+            const char * h = &header[0];
+            if (h[0] == '\0'){
+                fail("no matrix (.mtx) member found in the tar archive");
+                return false;
+            }
+
+            std::string name;
+            if (!long_name.empty()){
+                name.swap(long_name);
+            } else {
+                if (h[345] != '\0')
+                    name = std::string(h + 345, strnlen(h + 345, 155)) + "/";
+                name += std::string(h, strnlen(h, 100));
+            }
+
+            const char type = h[156];
+            const unsigned long long size = tar_member_size(h);
+            const unsigned long long padded = TAR_BLOCK_SIZE * ((size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE);
+
+            if ((type == '0' || type == '\0') && is_matrix_member(name)){
+                member_size = size;
+                return true;
+            }
+
+            // skip the member, keeping GNU long names for the next header
+            for (unsigned long long skipped = 0; skipped < padded; ){
+                const size_t want = (size_t) std::min<unsigned long long>(scratch.size(), padded - skipped);
+                size_t got;
+                if (!read_bytes(&scratch[0], want, got))
+                    return false;
+                if (got < want){
+                    fail("truncated tar archive");
+                    return false;
+                }
+                if (type == 'L' && skipped < size)
+                    long_name.append(&scratch[0], strnlen(&scratch[0], (size_t) std::min<unsigned long long>(got, size - skipped)));
+                skipped += got;
+            }
+
+            size_t got;
+            if (!read_bytes(&header[0], TAR_BLOCK_SIZE, got))
+                return false;
+            if (got < TAR_BLOCK_SIZE){
+                fail("no matrix (.mtx) member found in the tar archive");
+                return false;
+            }
+        }
+    }
+
+    void produce()
+    {
+        std::vector<char> block(TAR_BLOCK_SIZE);
+        unsigned long long remaining = (unsigned long long) -1;   //bytes left to return
+
+        size_t got;
+        if (!read_bytes(&block[0], TAR_BLOCK_SIZE, got)){
+            finish();
+            return;
+        }
+        block.resize(got);
+
+        const bool in_tar = got == TAR_BLOCK_SIZE && is_tar_header(&block[0]);
+        if (in_tar){
+            if (!seek_tar_member(block, remaining)){
+                finish();
+                return;
+            }
+            block.clear();
+        }
+
+        while (remaining > 0){
+            const size_t offset = block.size();
+            const size_t want = (size_t) std::min<unsigned long long>(block_size - offset, remaining);
+
+            block.resize(offset + want);
+            if (!read_bytes(&block[offset], want, got))
+                break;
+            block.resize(offset + got);
+            remaining -= got;
+
+            if (!push(block))
+                break;
+
+            if (got < want){
+                // the stream ended: inside a tar member that means truncation
+                if (in_tar)
+                    fail("truncated tar archive");
+                break;
+            }
+            block.reserve(block_size);
+        }
+
+        finish();
+    }
+
+public:
+    gzip_block_reader(const char * filename, const size_t block_size = (16 << 20), const size_t max_queued = 2)
+        : block_size(block_size), max_queued(max_queued), finished(false), stopped(false)
+    {
+        file = gzopen(filename, "rb");
+        if (file == NULL){
+            printf("Unable to open file %s\n", filename);
+            exit(1);
+        }
+        gzbuffer(file, 1 << 20);
+
+        producer = std::thread(&gzip_block_reader::produce, this);
+    }
+
+    ~gzip_block_reader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+            changed.notify_all();
+        }
+        producer.join();
+        gzclose(file);
+    }
+
+    // the next block of decompressed data; false at the end of the stream
+    bool next(std::vector<char>& block)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.empty() && !finished)
+            changed.wait(lock);
+
+        if (!queue.empty()){
+            block.swap(queue.front());
+            queue.pop_front();
+            changed.notify_all();
+            return true;
+        }
+
+        if (!error.empty()){
+            printf("\nError reading compressed input: %s\n", error.c_str());
+            exit(1);
+        }
+
+        block.clear();
+        return false;
+    }
+};
@@ -18,11 +18,13 @@
 #include <stdlib.h>
 
 
-typedef struct row_len_str 
+// length and original position of a row, for reordering rows by length
+template <typename IndexType>
+struct RowStr
 {
-  short int len;
-  int orig_pos;
-} RowStr;
+  IndexType len;
+  IndexType orig_pos;
+};
 
 /////////////////////////////////////////////////////////////////////
 // allocate memory on host and device
@@ -0,0 +1,76 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+// Read-only memory mapping of input files
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct mapped_file
+{
+    const char * data;  //start of the mapping (NULL for an empty file)
+    size_t size;        //size of the file in bytes
+};
+
+// Map a whole file read-only.  The pages are shared with the page cache, so
+// processes mapping the same file on one node share one physical copy.
+mapped_file map_file(const char * filename, const int advice = MADV_SEQUENTIAL)
+{
+    mapped_file file;
+    file.data = NULL;
+    file.size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0){
+        printf("Unable to open file %s\n", filename);
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        printf("Unable to stat file %s\n", filename);
+        exit(1);
+    }
+    file.size = (size_t) st.st_size;
+
+    if (file.size > 0){
+        void * ptr = mmap(NULL, file.size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED){
+            printf("Unable to map file %s\n", filename);
+            exit(1);
+        }
+        madvise(ptr, file.size, advice);
+        file.data = static_cast<const char *>(ptr);
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    return file;
+}
+
+void unmap_file(mapped_file& file)
+{
+    if (file.data != NULL)
+        munmap((void *) file.data, file.size);
+    file.data = NULL;
+    file.size = 0;
+}
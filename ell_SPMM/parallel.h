@@ -0,0 +1,146 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//! Thread helpers for the multithreaded host routines
+// Host loops are parallelized with OpenMP.  When the code is compiled without
+// OpenMP support the pragmas are ignored and these helpers report one thread,
+// so every routine degrades to its serial form.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// number of threads a parallel region will use
+int host_num_threads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// index of the calling thread inside a parallel region
+int host_thread_num()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+// number of threads in the team executing the current parallel region
+int host_team_size()
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Number of threads to use for a routine with per-thread histograms
+// Every thread keeps a private histogram of 'num_bins' counters.  The thread
+// count is capped so that the histograms together take no more memory than
+// the 'num_entries' indices being binned.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType>
+int histogram_num_threads(const IndexType num_bins, const IndexType num_entries)
+{
+    const long long limit = (num_bins == 0) ? 1 : (long long) num_entries / (long long) num_bins;
+    return (int) std::max<long long>(1, std::min<long long>(host_num_threads(), limit));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! In-place exclusive prefix sum of A[0,N), using all host threads
+// Each thread sums a contiguous block, the block sums are scanned serially,
+// and every thread then scans its own block starting from its offset.
+// Returns the sum of all elements.
+////////////////////////////////////////////////////////////////////////////////
+template <typename T, typename SizeType>
+T parallel_exclusive_scan(T * A, const SizeType N)
+{
+    // short arrays are not worth a parallel region
+    const int max_threads = (N < (1 << 16)) ? 1 : host_num_threads();
+    std::vector<T> block_sum(max_threads + 1, 0);
+    int num_blocks = 1;
+
+    #pragma omp parallel num_threads(max_threads)
+    {
+        const int num_threads = host_team_size();
+        const int t = host_thread_num();
+        const SizeType begin = (SizeType) (((unsigned long long) N *  t     ) / num_threads);
+        const SizeType end   = (SizeType) (((unsigned long long) N * (t + 1)) / num_threads);
+
+        T sum = 0;
+        for(SizeType i = begin; i < end; i++)
+            sum += A[i];
+        block_sum[t + 1] = sum;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            num_blocks = num_threads;
+            for(int s = 0; s < num_threads; s++)
+                block_sum[s + 1] += block_sum[s];
+        }
+
+        T cumsum = block_sum[t];
+        for(SizeType i = begin; i < end; i++){
+            T temp = A[i];
+            A[i] = cumsum;
+            cumsum += temp;
+        }
+    }
+
+    return block_sum[num_blocks];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Stable sort of [first,last), using all host threads
+// Each thread sorts a contiguous block, then neighbouring blocks are merged
+// pairwise, the merges of each round running in parallel.
+////////////////////////////////////////////////////////////////////////////////
+template <typename RandomIt, typename Compare>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare comp)
+{
+    const size_t N = last - first;
+    // short arrays are not worth a parallel region
+    const int num_blocks = (N < (1 << 16)) ? 1 : host_num_threads();
+
+    std::vector<size_t> bounds(num_blocks + 1);
+    for(int b = 0; b <= num_blocks; b++)
+        bounds[b] = (N * b) / num_blocks;
+
+    #pragma omp parallel for schedule(static,1) num_threads(num_blocks)
+    for(int b = 0; b < num_blocks; b++)
+        std::stable_sort(first + bounds[b], first + bounds[b + 1], comp);
+
+    for(int width = 1; width < num_blocks; width *= 2){
+        #pragma omp parallel for schedule(static,1)
+        for(int b = 0; b < num_blocks - width; b += 2 * width)
+            std::inplace_merge(first + bounds[b], first + bounds[b + width],
+                               first + bounds[std::min(b + 2 * width, num_blocks)], comp);
+    }
+}
@@ -0,0 +1,629 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//! Binary container for CSR and ELL matrices
+// A converted matrix is stored as a fixed header followed by the raw CSR
+// and/or ELL arrays, each starting on a 64-byte boundary.  The loader maps
+// the file read-only and points Ap/Aj/Ax straight into the mapping, so no
+// parsing or conversion is repeated and processes on the same node share
+// one physical copy of the matrix through the page cache.
+//
+// Layout (all offsets in bytes from the start of the file):
+//   binary_matrix_header
+//   CSR Ap [num_rows + 1], Aj [num_nonzeros], Ax [num_nonzeros]
+//   ELL Aj [stride * num_cols_per_row], Ax [stride * num_cols_per_row]
+//
+// Compressed CSR (version 2) replaces the three CSR arrays with
+//   block table  [num_blocks + 1] stream offsets, [num_blocks + 1] first nonzeros
+//   index stream per row: varint(length), then zigzag varint column deltas
+//   values       raw, exact single precision, or a single constant
+// Each block of 'block_rows' rows decodes independently, so the loader
+// decodes blocks in parallel straight into Ap/Aj/Ax.  This trades CPU time
+// for I/O and wins when cold loads are bound by filesystem bandwidth.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <stddef.h>
+
+#include "sparse_formats.h"
+#include "mmap_file.h"
+#include "parallel.h"
+#include "timer.h"
+
+#define BINARY_MATRIX_MAGIC     "SPMMBIN"
+#define BINARY_MATRIX_VERSION   2
+#define BINARY_MATRIX_ALIGNMENT 64
+
+// flags describing which formats the file holds
+#define BINARY_MATRIX_HAS_CSR         1
+#define BINARY_MATRIX_HAS_ELL         2
+#define BINARY_MATRIX_COMPRESSED_CSR  4   //CSR stored in compressed form
+
+// encodings of the values of a compressed CSR matrix
+#define BINARY_VALUES_RAW       0   //ValueType array
+#define BINARY_VALUES_FLOAT     1   //doubles that are exact in single precision
+#define BINARY_VALUES_CONSTANT  2   //all values equal, one ValueType stored
+
+// rows per independently decodable block of a compressed CSR matrix
+#define BINARY_BLOCK_ROWS       4096
+
+struct binary_matrix_header
+{
+    char magic[8];                 //BINARY_MATRIX_MAGIC, NUL terminated
+    unsigned int version;          //BINARY_MATRIX_VERSION
+    unsigned int flags;            //BINARY_MATRIX_HAS_*
+    unsigned int index_size;       //sizeof(IndexType)
+    unsigned int value_size;       //sizeof(ValueType)
+
+    unsigned long long num_rows;
+    unsigned long long num_cols;
+    unsigned long long num_nonzeros;
+
+    unsigned long long ell_num_nonzeros;
+    unsigned long long ell_stride;
+    unsigned long long ell_num_cols_per_row;
+
+    unsigned long long csr_Ap_offset;
+    unsigned long long csr_Aj_offset;
+    unsigned long long csr_Ax_offset;
+    unsigned long long ell_Aj_offset;
+    unsigned long long ell_Ax_offset;
+
+    unsigned long long file_size;
+
+    // version 2: compressed CSR
+    unsigned long long block_rows;
+    unsigned long long num_blocks;
+    unsigned long long block_table_offset;
+    unsigned long long index_stream_offset;
+    unsigned long long index_stream_size;
+    unsigned long long values_offset;
+    unsigned int value_encoding;   //BINARY_VALUES_*
+    unsigned int reserved;
+};
+
+// version 1 files end their header before the compression fields
+#define BINARY_MATRIX_HEADER_V1_SIZE offsetof(binary_matrix_header, block_rows)
+
+// round up to the next multiple of BINARY_MATRIX_ALIGNMENT
+unsigned long long binary_align(const unsigned long long offset)
+{
+    return BINARY_MATRIX_ALIGNMENT * ((offset + BINARY_MATRIX_ALIGNMENT - 1) / BINARY_MATRIX_ALIGNMENT);
+}
+
+// write N bytes from ptr at 'offset', zero filling any gap before it
+void binary_write_at(FILE * fid, const unsigned long long offset, const void * ptr, const size_t N)
+{
+    static const char zeros[BINARY_MATRIX_ALIGNMENT] = {0};
+
+    long position = ftell(fid);
+    while((unsigned long long) position < offset){
+        size_t gap = std::min<unsigned long long>(offset - position, BINARY_MATRIX_ALIGNMENT);
+        fwrite(zeros, 1, gap, fid);
+        position += gap;
+    }
+
+    if (N > 0 && fwrite(ptr, 1, N, fid) != N){
+        printf("Error writing binary matrix file\n");
+        exit(1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Variable length integers for the compressed index stream
+// LEB128: 7 bits per byte, the high bit marks that more bytes follow.
+// Column deltas may be negative (rows need not be sorted) and are zigzag
+// mapped first so that small magnitudes of either sign stay short.
+////////////////////////////////////////////////////////////////////////////////
+
+size_t varint_size(unsigned long long v)
+{
+    size_t n = 1;
+    while(v >= 128){ v >>= 7; n++; }
+    return n;
+}
+
+unsigned char * varint_encode(unsigned char * p, unsigned long long v)
+{
+    while(v >= 128){
+        *p++ = (unsigned char) (v | 128);
+        v >>= 7;
+    }
+    *p++ = (unsigned char) v;
+    return p;
+}
+
+// returns NULL if the varint runs past 'end'
+const unsigned char * varint_decode(const unsigned char * p, const unsigned char * end, unsigned long long& v)
+{
+    v = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7){
+        const unsigned char byte = *p++;
+        v |= (unsigned long long) (byte & 127) << shift;
+        if(byte < 128)
+            return p;
+    }
+    return NULL;
+}
+
+unsigned long long zigzag_encode(const long long v)
+{
+    return ((unsigned long long) v << 1) ^ (unsigned long long) (v >> 63);
+}
+
+long long zigzag_decode(const unsigned long long v)
+{
+    return (long long) (v >> 1) ^ -(long long) (v & 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Encode the column indices of rows [row_begin,row_end) of a CSR matrix
+// Each row is its length followed by the column deltas; the first delta is
+// taken from the row index so banded matrices encode in one byte per entry.
+// Returns the number of bytes written; with out == NULL only the size is computed.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+size_t encode_csr_rows(const csr_matrix<IndexType,ValueType>& csr,
+                       const IndexType row_begin, const IndexType row_end,
+                       unsigned char * out)
+{
+    size_t size = 0;
+    unsigned char * p = out;
+
+    for(IndexType i = row_begin; i < row_end; i++){
+        const unsigned long long length = csr.Ap[i+1] - csr.Ap[i];
+        if(out) p = varint_encode(p, length);
+        else    size += varint_size(length);
+
+        long long prev = (long long) i;
+        for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+            const unsigned long long delta = zigzag_encode((long long) csr.Aj[jj] - prev);
+            if(out) p = varint_encode(p, delta);
+            else    size += varint_size(delta);
+            prev = (long long) csr.Aj[jj];
+        }
+    }
+
+    return out ? (size_t) (p - out) : size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decode rows [row_begin,row_end) owning nonzeros [nz,nz_end) into Ap and Aj
+// Returns false if the stream is corrupt.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType>
+bool decode_csr_rows(const unsigned char * p, const unsigned char * end,
+                     const IndexType row_begin, const IndexType row_end,
+                     IndexType nz, const IndexType nz_end, const IndexType num_cols,
+                     IndexType * Ap, IndexType * Aj)
+{
+    for(IndexType i = row_begin; i < row_end; i++){
+        unsigned long long length;
+        if((p = varint_decode(p, end, length)) == NULL)
+            return false;
+
+        Ap[i] = nz;
+        if(length > (unsigned long long) (nz_end - nz))
+            return false;
+
+        long long prev = (long long) i;
+        for(unsigned long long n = 0; n < length; n++){
+            unsigned long long delta;
+            if((p = varint_decode(p, end, delta)) == NULL)
+                return false;
+            const long long col = prev + zigzag_decode(delta);
+            if(col < 0 || col >= (long long) num_cols)
+                return false;
+            Aj[nz++] = (IndexType) col;
+            prev = col;
+        }
+    }
+    return nz == nz_end;
+}
+
+// pick the most compact lossless encoding for the values of a CSR matrix
+template <typename IndexType, typename ValueType>
+unsigned int choose_value_encoding(const csr_matrix<IndexType,ValueType>& csr)
+{
+    bool constant = true;
+    bool exact_float = sizeof(ValueType) > sizeof(float);
+
+    for(IndexType i = 0; i < csr.num_nonzeros && (constant || exact_float); i++){
+        constant    = constant    && csr.Ax[i] == csr.Ax[0];
+        exact_float = exact_float && (ValueType) (float) csr.Ax[i] == csr.Ax[i];
+    }
+
+    if (constant && csr.num_nonzeros > 0) return BINARY_VALUES_CONSTANT;
+    if (exact_float)                      return BINARY_VALUES_FLOAT;
+    return BINARY_VALUES_RAW;
+}
+
+size_t binary_value_bytes(const unsigned int encoding, const size_t value_size, const unsigned long long num_nonzeros)
+{
+    if (encoding == BINARY_VALUES_CONSTANT) return value_size;
+    if (encoding == BINARY_VALUES_FLOAT)    return sizeof(float) * num_nonzeros;
+    return value_size * num_nonzeros;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write a CSR and/or ELL matrix to a binary container
+//! @param filename   output file
+//! @param csr        CSR matrix, or NULL
+//! @param ell        ELL matrix, or NULL
+//! @param compress   store the CSR part in compressed form
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void write_binary_matrix(const char * filename,
+                         const csr_matrix<IndexType,ValueType> * csr,
+                         const ell_matrix<IndexType,ValueType> * ell,
+                         const bool compress = false)
+{
+    binary_matrix_header header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, BINARY_MATRIX_MAGIC);
+    header.version    = BINARY_MATRIX_VERSION;
+    header.index_size = sizeof(IndexType);
+    header.value_size = sizeof(ValueType);
+
+    const matrix_shape<IndexType> * shape = (csr != NULL) ? (const matrix_shape<IndexType> *) csr
+                                                          : (const matrix_shape<IndexType> *) ell;
+    header.num_rows     = shape->num_rows;
+    header.num_cols     = shape->num_cols;
+    header.num_nonzeros = shape->num_nonzeros;
+
+    unsigned long long offset = binary_align(sizeof(header));
+
+    unsigned long long * block_table = NULL;
+    unsigned char * index_stream = NULL;
+
+    if (csr != NULL && compress){
+        header.flags |= BINARY_MATRIX_HAS_CSR | BINARY_MATRIX_COMPRESSED_CSR;
+        header.block_rows = BINARY_BLOCK_ROWS;
+        header.num_blocks = (header.num_rows + BINARY_BLOCK_ROWS - 1) / BINARY_BLOCK_ROWS;
+        header.value_encoding = choose_value_encoding(*csr);
+
+        // stream offsets of each block followed by the first nonzero of each block
+        const long long num_blocks = header.num_blocks;
+        block_table = new_host_array<unsigned long long>(2 * (num_blocks + 1));
+        unsigned long long * block_offset = block_table;
+        unsigned long long * block_first  = block_table + num_blocks + 1;
+
+        #pragma omp parallel for schedule(dynamic)
+        for(long long b = 0; b < num_blocks; b++){
+            const IndexType row_begin = (IndexType) (b * BINARY_BLOCK_ROWS);
+            const IndexType row_end   = (IndexType) std::min<unsigned long long>((b + 1) * BINARY_BLOCK_ROWS, header.num_rows);
+            block_offset[b + 1] = encode_csr_rows(*csr, row_begin, row_end, (unsigned char *) NULL);
+            block_first[b] = csr->Ap[row_begin];
+        }
+        block_offset[0] = 0;
+        for(long long b = 0; b < num_blocks; b++)
+            block_offset[b + 1] += block_offset[b];
+        block_first[num_blocks] = header.num_nonzeros;
+
+        header.index_stream_size = block_offset[num_blocks];
+        index_stream = new_host_array<unsigned char>(header.index_stream_size);
+
+        #pragma omp parallel for schedule(dynamic)
+        for(long long b = 0; b < num_blocks; b++){
+            const IndexType row_begin = (IndexType) (b * BINARY_BLOCK_ROWS);
+            const IndexType row_end   = (IndexType) std::min<unsigned long long>((b + 1) * BINARY_BLOCK_ROWS, header.num_rows);
+            encode_csr_rows(*csr, row_begin, row_end, index_stream + block_offset[b]);
+        }
+
+        header.block_table_offset = offset;
+        offset = binary_align(offset + sizeof(unsigned long long) * 2 * (num_blocks + 1));
+        header.index_stream_offset = offset;
+        offset = binary_align(offset + header.index_stream_size);
+        header.values_offset = offset;
+        offset = binary_align(offset + binary_value_bytes(header.value_encoding, sizeof(ValueType), header.num_nonzeros));
+    } else if (csr != NULL){
+        header.flags |= BINARY_MATRIX_HAS_CSR;
+        header.csr_Ap_offset = offset;
+        offset = binary_align(offset + sizeof(IndexType) * (header.num_rows + 1));
+        header.csr_Aj_offset = offset;
+        offset = binary_align(offset + sizeof(IndexType) * header.num_nonzeros);
+        header.csr_Ax_offset = offset;
+        offset = binary_align(offset + sizeof(ValueType) * header.num_nonzeros);
+    }
+
+    if (ell != NULL){
+        const unsigned long long ell_size = (unsigned long long) ell->stride * ell->num_cols_per_row;
+        header.flags |= BINARY_MATRIX_HAS_ELL;
+        header.ell_num_nonzeros     = ell->num_nonzeros;
+        header.ell_stride           = ell->stride;
+        header.ell_num_cols_per_row = ell->num_cols_per_row;
+        header.ell_Aj_offset = offset;
+        offset = binary_align(offset + sizeof(IndexType) * ell_size);
+        header.ell_Ax_offset = offset;
+        offset = binary_align(offset + sizeof(ValueType) * ell_size);
+    }
+
+    header.file_size = offset;
+
+    FILE * fid = fopen(filename, "wb");
+    if (fid == NULL){
+        printf("Unable to open file %s\n", filename);
+        exit(1);
+    }
+
+    binary_write_at(fid, 0, &header, sizeof(header));
+
+    if (csr != NULL && compress){
+        binary_write_at(fid, header.block_table_offset, block_table, sizeof(unsigned long long) * 2 * (header.num_blocks + 1));
+        binary_write_at(fid, header.index_stream_offset, index_stream, header.index_stream_size);
+
+        if (header.value_encoding == BINARY_VALUES_FLOAT){
+            float * values = new_host_array<float>(header.num_nonzeros);
+            for(IndexType i = 0; i < csr->num_nonzeros; i++)
+                values[i] = (float) csr->Ax[i];
+            binary_write_at(fid, header.values_offset, values, sizeof(float) * header.num_nonzeros);
+            delete_host_array(values);
+        } else {
+            binary_write_at(fid, header.values_offset, csr->Ax,
+                            binary_value_bytes(header.value_encoding, sizeof(ValueType), header.num_nonzeros));
+        }
+
+        delete_host_array(block_table);
+        delete_host_array(index_stream);
+    } else if (csr != NULL){
+        binary_write_at(fid, header.csr_Ap_offset, csr->Ap, sizeof(IndexType) * (header.num_rows + 1));
+        binary_write_at(fid, header.csr_Aj_offset, csr->Aj, sizeof(IndexType) * header.num_nonzeros);
+        binary_write_at(fid, header.csr_Ax_offset, csr->Ax, sizeof(ValueType) * header.num_nonzeros);
+    }
+
+    if (ell != NULL){
+        const size_t ell_size = (size_t) ell->stride * ell->num_cols_per_row;
+        binary_write_at(fid, header.ell_Aj_offset, ell->Aj, sizeof(IndexType) * ell_size);
+        binary_write_at(fid, header.ell_Ax_offset, ell->Ax, sizeof(ValueType) * ell_size);
+    }
+
+    binary_write_at(fid, header.file_size, NULL, 0);
+
+    fclose(fid);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! A binary container mapped into memory
+// csr and ell point into the mapping and must not be passed to
+// delete_host_matrix(); release them with close_binary_matrix() instead.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+struct binary_matrix_file
+{
+    mapped_file file;
+    bool has_csr;
+    bool has_ell;
+    bool owns_csr;   //csr was decoded into host arrays rather than mapped
+    csr_matrix<IndexType,ValueType> csr;
+    ell_matrix<IndexType,ValueType> ell;
+};
+
+// true if 'filename' starts with the binary container magic
+bool is_binary_matrix_file(const char * filename)
+{
+    char magic[sizeof(BINARY_MATRIX_MAGIC)] = {0};
+
+    FILE * fid = fopen(filename, "rb");
+    if (fid == NULL)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), fid);
+    fclose(fid);
+
+    return n == sizeof(magic) && memcmp(magic, BINARY_MATRIX_MAGIC, sizeof(magic)) == 0;
+}
+
+// read the header of a binary container without mapping the arrays
+binary_matrix_header read_binary_matrix_header(const char * filename)
+{
+    binary_matrix_header header;
+
+    FILE * fid = fopen(filename, "rb");
+    if (fid == NULL){
+        printf("Unable to open file %s\n", filename);
+        exit(1);
+    }
+    memset(&header, 0, sizeof(header));
+    if (fread(&header, BINARY_MATRIX_HEADER_V1_SIZE, 1, fid) != 1 ||
+        memcmp(header.magic, BINARY_MATRIX_MAGIC, sizeof(BINARY_MATRIX_MAGIC)) != 0){
+        printf("%s is not a binary matrix file\n", filename);
+        exit(1);
+    }
+
+    if (header.version < 1 || header.version > BINARY_MATRIX_VERSION){
+        printf("Unsupported binary matrix version %u (expected at most %u)\n", header.version, BINARY_MATRIX_VERSION);
+        exit(1);
+    }
+
+    if (header.version >= 2 &&
+        fread((char *) &header + BINARY_MATRIX_HEADER_V1_SIZE, sizeof(header) - BINARY_MATRIX_HEADER_V1_SIZE, 1, fid) != 1){
+        printf("Truncated binary matrix file %s\n", filename);
+        exit(1);
+    }
+    fclose(fid);
+
+    return header;
+}
+
+template <typename T>
+T * binary_array(const mapped_file& file, const unsigned long long offset, const unsigned long long N)
+{
+    if (offset % BINARY_MATRIX_ALIGNMENT != 0 || offset + sizeof(T) * N > file.size){
+        printf("Corrupt binary matrix file\n");
+        exit(1);
+    }
+    return (T *) (file.data + offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decode the compressed CSR part of a mapped container into host arrays
+// Row blocks are decoded in parallel.  Reports the bytes read, the
+// compression ratio relative to the raw CSR arrays and the decode rate.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+csr_matrix<IndexType,ValueType> decode_binary_csr(const mapped_file& file, const binary_matrix_header& header)
+{
+    const long long num_blocks = header.num_blocks;
+    const size_t value_bytes = binary_value_bytes(header.value_encoding, sizeof(ValueType), header.num_nonzeros);
+
+    const unsigned long long * block_table = binary_array<unsigned long long>(file, header.block_table_offset, 2 * (num_blocks + 1));
+    const unsigned long long * block_offset = block_table;
+    const unsigned long long * block_first  = block_table + num_blocks + 1;
+    const unsigned char * stream = binary_array<unsigned char>(file, header.index_stream_offset, header.index_stream_size);
+    const char * values = binary_array<char>(file, header.values_offset, value_bytes);
+
+    if (block_offset[num_blocks] != header.index_stream_size || block_first[num_blocks] != header.num_nonzeros ||
+        header.num_blocks != (header.num_rows + header.block_rows - 1) / std::max<unsigned long long>(header.block_rows, 1)){
+        printf("Corrupt binary matrix file\n");
+        exit(1);
+    }
+
+    // every block must lie within the stream and own a range of the nonzeros
+    // before any of them is decoded
+    for(long long b = 0; b < num_blocks; b++){
+        if (block_offset[b] > block_offset[b + 1] || block_first[b] > block_first[b + 1]){
+            printf("Corrupt binary matrix file\n");
+            exit(1);
+        }
+    }
+
+    csr_matrix<IndexType,ValueType> csr;
+    csr.num_rows     = (IndexType) header.num_rows;
+    csr.num_cols     = (IndexType) header.num_cols;
+    csr.num_nonzeros = (IndexType) header.num_nonzeros;
+    csr.Ap = new_host_array<IndexType>(csr.num_rows + 1);
+    csr.Aj = new_host_array<IndexType>(csr.num_nonzeros);
+    csr.Ax = new_host_array<ValueType>(csr.num_nonzeros);
+
+    printf("Decoding compressed matrix:");
+    fflush(stdout);
+
+    host_timer t;
+
+    bool corrupt = false;
+    #pragma omp parallel for schedule(dynamic) reduction(||:corrupt)
+    for(long long b = 0; b < num_blocks; b++){
+        const IndexType row_begin = (IndexType) (b * header.block_rows);
+        const IndexType row_end   = (IndexType) std::min<unsigned long long>((b + 1) * header.block_rows, header.num_rows);
+        const IndexType nz_begin  = (IndexType) block_first[b];
+        const IndexType nz_end    = (IndexType) block_first[b + 1];
+
+        if (!decode_csr_rows(stream + block_offset[b], stream + block_offset[b + 1],
+                             row_begin, row_end, nz_begin, nz_end, csr.num_cols, csr.Ap, csr.Aj)){
+            corrupt = true;
+            continue;
+        }
+
+        // values of the nonzeros owned by this block
+        if (header.value_encoding == BINARY_VALUES_CONSTANT){
+            const ValueType v = *(const ValueType *) values;
+            std::fill(csr.Ax + nz_begin, csr.Ax + nz_end, v);
+        } else if (header.value_encoding == BINARY_VALUES_FLOAT){
+            const float * v = (const float *) values;
+            for(IndexType i = nz_begin; i < nz_end; i++)
+                csr.Ax[i] = (ValueType) v[i];
+        } else {
+            memcpy(csr.Ax + nz_begin, (const ValueType *) values + nz_begin, sizeof(ValueType) * (nz_end - nz_begin));
+        }
+    }
+    csr.Ap[csr.num_rows] = csr.num_nonzeros;
+
+    if (corrupt){
+        printf("\nCorrupt binary matrix file\n");
+        exit(1);
+    }
+
+    const double seconds = t.seconds_elapsed();
+    const double compressed_bytes = sizeof(unsigned long long) * 2.0 * (num_blocks + 1) + header.index_stream_size + value_bytes;
+    const double raw_bytes = sizeof(IndexType) * (header.num_rows + 1.0) + (sizeof(IndexType) + sizeof(ValueType)) * (double) header.num_nonzeros;
+
+    printf(" done (%.1f MB read, %.2fx compression, %.2f GB/s decode)\n",
+           compressed_bytes / 1e6, raw_bytes / compressed_bytes, (seconds == 0) ? 0.0 : (raw_bytes / seconds) / 1e9);
+
+    return csr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Map a binary container written by write_binary_matrix()
+// IndexType and ValueType must match the widths stored in the file.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+binary_matrix_file<IndexType,ValueType> open_binary_matrix(const char * filename)
+{
+    binary_matrix_header header = read_binary_matrix_header(filename);
+
+    if (header.index_size != sizeof(IndexType) || header.value_size != sizeof(ValueType)){
+        printf("%s stores %u-byte indices and %u-byte values, expected %d and %d\n", filename,
+               header.index_size, header.value_size, (int) sizeof(IndexType), (int) sizeof(ValueType));
+        exit(1);
+    }
+
+    binary_matrix_file<IndexType,ValueType> bin;
+    memset(&bin.csr, 0, sizeof(bin.csr));
+    memset(&bin.ell, 0, sizeof(bin.ell));
+
+    bin.file = map_file(filename, MADV_WILLNEED);
+    if (bin.file.size < header.file_size){
+        printf("Truncated binary matrix file %s\n", filename);
+        exit(1);
+    }
+
+    bin.has_csr  = (header.flags & BINARY_MATRIX_HAS_CSR) != 0;
+    bin.has_ell  = (header.flags & BINARY_MATRIX_HAS_ELL) != 0;
+    bin.owns_csr = (header.flags & BINARY_MATRIX_COMPRESSED_CSR) != 0;
+
+    if (bin.has_csr && bin.owns_csr){
+        bin.csr = decode_binary_csr<IndexType,ValueType>(bin.file, header);
+    } else if (bin.has_csr){
+        csr_matrix<IndexType,ValueType>& csr = bin.csr;
+        csr.num_rows     = (IndexType) header.num_rows;
+        csr.num_cols     = (IndexType) header.num_cols;
+        csr.num_nonzeros = (IndexType) header.num_nonzeros;
+        csr.Ap = binary_array<IndexType>(bin.file, header.csr_Ap_offset, header.num_rows + 1);
+        csr.Aj = binary_array<IndexType>(bin.file, header.csr_Aj_offset, header.num_nonzeros);
+        csr.Ax = binary_array<ValueType>(bin.file, header.csr_Ax_offset, header.num_nonzeros);
+    }
+
+    if (bin.has_ell){
+        const unsigned long long ell_size = header.ell_stride * header.ell_num_cols_per_row;
+        ell_matrix<IndexType,ValueType>& ell = bin.ell;
+        ell.num_rows         = (IndexType) header.num_rows;
+        ell.num_cols         = (IndexType) header.num_cols;
+        ell.num_nonzeros     = (IndexType) header.ell_num_nonzeros;
+        ell.stride           = (IndexType) header.ell_stride;
+        ell.num_cols_per_row = (IndexType) header.ell_num_cols_per_row;
+        ell.Aj = binary_array<IndexType>(bin.file, header.ell_Aj_offset, ell_size);
+        ell.Ax = binary_array<ValueType>(bin.file, header.ell_Ax_offset, ell_size);
+    }
+
+    return bin;
+}
+
+template <typename IndexType, typename ValueType>
+void close_binary_matrix(binary_matrix_file<IndexType,ValueType>& bin)
+{
+    if (bin.has_csr && bin.owns_csr)
+        delete_host_matrix(bin.csr);
+    unmap_file(bin.file);
+    bin.has_csr  = false;
+    bin.has_ell  = false;
+    bin.owns_csr = false;
+}
@@ -16,7 +16,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include "sparse_operations.h"
+#include "parallel.h"
 ////////////////////////////////////////////////////////////////////////////////
 //! Convert CSR format to HYB (hybrid ELL/COO) format
 // If the ELL portion of the HYB matrix will have 'num_cols_per_row' columns.
@@ -93,37 +95,1067 @@ hyb_matrix<IndexType, ValueType>
     return hyb;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Length of the longest row of a CSR matrix
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+IndexType csr_max_row_length(const IndexType num_rows, const IndexType * Ap)
+{
+    IndexType max_length = 0;
+    #pragma omp parallel for schedule(static) reduction(max:max_length)
+    for(IndexType i = 0; i < num_rows; i++)
+        max_length = std::max(max_length, Ap[i+1] - Ap[i]);
+    return max_length;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //! Convert CSR format to ELL format
 // If the matrix has more than 'max_cols_per_row' columns in any row, then 
 // an ell_matrix with dimensions (0,0) and 0 nonzeros is returned. Rows with 
 // fewer than 'num_cols_per_row' columns are padded with zeros.
+// Row blocks are converted in parallel.  Each thread writes (and so first
+// touches) the slots of its own rows, entries and padding tail alike, and
+// the rows past num_rows up to the stride; nothing is written twice.
 ////////////////////////////////////////////////////////////////////////////////
 template <class IndexType, class ValueType>
 ell_matrix<IndexType, ValueType>
  csr_to_ell(const csr_matrix<IndexType,ValueType>& csr, const IndexType max_cols_per_row, const IndexType alignment = 16)
 {
+    ell_matrix<IndexType, ValueType> ell;
+
     // compute maximum number of columns in any row
-    IndexType num_cols_per_row = 0;
-    for(IndexType i = 0; i < csr.num_rows; i++)
-        num_cols_per_row = std::max(num_cols_per_row, csr.Ap[i+1] - csr.Ap[i]); 
-    
+    const IndexType num_cols_per_row = csr_max_row_length(csr.num_rows, csr.Ap);
     
+    ell.num_cols_per_row = num_cols_per_row;
+
     if(num_cols_per_row > max_cols_per_row){
         //too many columns
-        ell_matrix<IndexType, ValueType> ell;
         ell.Aj = NULL;
         ell.Ax = NULL;
         ell.num_rows = 0;
         ell.num_cols = 0;
         ell.num_nonzeros = 0;
         ell.stride = 0;
-        ell.num_cols_per_row = num_cols_per_row;
         return ell;
-    } else {
-        // use CSR->HYB and grab the ELL portion
-        return csr_to_hyb(csr, num_cols_per_row, alignment).ell;
     }
+
+    ell.num_rows     = csr.num_rows;
+    ell.num_cols     = csr.num_cols;
+    ell.num_nonzeros = csr.num_nonzeros;
+    ell.stride       = alignment * ((ell.num_rows + alignment - 1)/ alignment);
+
+    ell.Aj = new_host_array<IndexType>(ell.num_cols_per_row * ell.stride);
+    ell.Ax = new_host_array<ValueType>(ell.num_cols_per_row * ell.stride);
+
+    const IndexType stride = ell.stride;
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < stride; i++){
+        const IndexType row_start = (i < csr.num_rows) ? csr.Ap[i]   : 0;
+        const IndexType row_end   = (i < csr.num_rows) ? csr.Ap[i+1] : 0;
+
+        IndexType n = 0;
+        for(IndexType jj = row_start; jj < row_end; jj++, n++){
+            ell.Aj[stride * n + i] = csr.Aj[jj];
+            ell.Ax[stride * n + i] = csr.Ax[jj];
+        }
+        // pad out the tail of the row with zeros
+        for(; n < num_cols_per_row; n++){
+            ell.Aj[stride * n + i] = 0;
+            ell.Ax[stride * n + i] = 0;
+        }
+    }
+
+    return ell;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to ELL-R format (ELL with row lengths)
+// The ELL part is built by csr_to_ell, including its rejection of matrices
+// with more than 'max_cols_per_row' columns in any row (Arl is then NULL).
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+ellr_matrix<IndexType, ValueType>
+ csr_to_ellr(const csr_matrix<IndexType,ValueType>& csr, const IndexType max_cols_per_row, const IndexType alignment = 16)
+{
+    ellr_matrix<IndexType, ValueType> ellr;
+    static_cast< ell_matrix<IndexType,ValueType>& >(ellr) = csr_to_ell(csr, max_cols_per_row, alignment);
+
+    if(ellr.num_nonzeros == 0 && csr.num_nonzeros != 0){
+        ellr.Arl = NULL;
+        return ellr;
+    }
+
+    ellr.Arl = new_host_array<IndexType>(ellr.num_rows);
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < ellr.num_rows; i++)
+        ellr.Arl[i] = csr.Ap[i+1] - csr.Ap[i];
+
+    return ellr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to ELL16 format (ELL with 16-bit column offsets)
+// The ELL arrays are built by csr_to_ell, including its rejection of
+// matrices with more than 'max_cols_per_row' columns in any row; the values
+// are kept and the column indices of each row block are rewritten as
+// offsets from its smallest column, or kept whole if they span more than
+// 65536 columns.  Slots with value zero are never decoded by the kernel and
+// do not count towards the span.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+ell16_matrix<IndexType, ValueType>
+ csr_to_ell16(const csr_matrix<IndexType,ValueType>& csr, const IndexType max_cols_per_row)
+{
+    const IndexType B = ELL16_BLOCK_ROWS;
+
+    ell_matrix<IndexType, ValueType> ell = csr_to_ell(csr, max_cols_per_row, B);
+
+    ell16_matrix<IndexType, ValueType> ell16;
+    ell16.num_rows          = ell.num_rows;
+    ell16.num_cols          = ell.num_cols;
+    ell16.num_nonzeros      = ell.num_nonzeros;
+    ell16.stride            = ell.stride;
+    ell16.num_cols_per_row  = ell.num_cols_per_row;
+    ell16.num_blocks        = ell.stride / B;
+    ell16.Ax                = ell.Ax;
+
+    const IndexType stride           = ell.stride;
+    const IndexType num_cols_per_row = ell.num_cols_per_row;
+    const IndexType num_blocks       = ell16.num_blocks;
+
+    ell16.block_base = new_host_array<IndexType>(num_blocks);
+    ell16.wide_pos   = new_host_array<IndexType>(num_blocks);
+
+    IndexType num_wide_nonzeros = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:num_wide_nonzeros)
+    for(IndexType b = 0; b < num_blocks; b++){
+        IndexType min_col = std::numeric_limits<IndexType>::max();
+        IndexType max_col = 0;
+        IndexType block_nonzeros = 0;
+        for(IndexType n = 0; n < num_cols_per_row; n++){
+            for(IndexType i = b * B; i < (b + 1) * B; i++){
+                if(ell.Ax[stride * n + i] != 0){
+                    min_col = std::min(min_col, ell.Aj[stride * n + i]);
+                    max_col = std::max(max_col, ell.Aj[stride * n + i]);
+                    block_nonzeros++;
+                }
+            }
+        }
+        const bool wide = block_nonzeros > 0 && max_col - min_col > 65535;
+        ell16.block_base[b] = wide ? (IndexType) -1 : (block_nonzeros > 0 ? min_col : 0);
+        ell16.wide_pos[b]   = wide ? 1 : 0;
+        if(wide)
+            num_wide_nonzeros += block_nonzeros;
+    }
+
+    ell16.num_wide_blocks   = parallel_exclusive_scan(ell16.wide_pos, num_blocks);
+    ell16.num_wide_nonzeros = num_wide_nonzeros;
+
+    ell16.Ajs = new_host_array<unsigned short>(stride * num_cols_per_row);
+    ell16.Aj  = new_host_array<IndexType>(ell16.num_wide_blocks * num_cols_per_row * B);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType b = 0; b < num_blocks; b++){
+        const IndexType base = ell16.block_base[b];
+        for(IndexType n = 0; n < num_cols_per_row; n++){
+            for(IndexType i = b * B; i < (b + 1) * B; i++){
+                const IndexType slot = stride * n + i;
+                if(base != (IndexType) -1){
+                    ell16.Ajs[slot] = (ell.Ax[slot] != 0) ? (unsigned short) (ell.Aj[slot] - base) : 0;
+                } else {
+                    ell16.Ajs[slot] = 0;
+                    ell16.Aj[(ell16.wide_pos[b] * num_cols_per_row + n) * B + (i - b * B)] = ell.Aj[slot];
+                }
+            }
+        }
+    }
+
+    delete_host_array(ell.Aj);
+
+    return ell16;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Copy the values of a CSR matrix into an ELL matrix of the same structure
+// 'ell' must have been built from 'csr' (e.g. by csr_to_ell) so that slot n
+// of row i holds the n-th entry of that row.  Only Ax is written.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void csr_to_ell_values(const csr_matrix<IndexType,ValueType>& csr, ell_matrix<IndexType,ValueType>& ell)
+{
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < csr.num_rows; i++){
+        const IndexType row_start = csr.Ap[i];
+        const IndexType row_end   = csr.Ap[i+1];
+        for(IndexType n = 0; n < ell.num_cols_per_row; n++)
+            ell.Ax[ell.stride * n + i] = (row_start + n < row_end) ? csr.Ax[row_start + n] : 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Copy an ELL matrix with its values rounded to MatrixType
+// Used to store fp64 coefficients in fp32 or bfloat16 for the mixed precision
+// kernels.  Values that round to zero become padding, which the kernels skip.
+////////////////////////////////////////////////////////////////////////////////
+template <class MatrixType, class IndexType, class ValueType>
+ell_matrix<IndexType, MatrixType>
+convert_ell_values(const ell_matrix<IndexType,ValueType>& ell)
+{
+    ell_matrix<IndexType, MatrixType> result;
+    result.num_rows         = ell.num_rows;
+    result.num_cols         = ell.num_cols;
+    result.num_nonzeros     = ell.num_nonzeros;
+    result.stride           = ell.stride;
+    result.num_cols_per_row = ell.num_cols_per_row;
+
+    const IndexType num_slots = ell.stride * ell.num_cols_per_row;
+    result.Aj = new_host_array<IndexType>(num_slots);
+    result.Ax = new_host_array<MatrixType>(num_slots);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType n = 0; n < num_slots; n++){
+        result.Aj[n] = ell.Aj[n];
+        result.Ax[n] = (MatrixType) ell.Ax[n];
+    }
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Quantize the n values of one row, 'step' apart, to QuantType
+// The scale maps the largest magnitude of the row to the largest QuantType
+// and every value is rounded to the nearest multiple of the scale.  Returns
+// the largest rounding error of the row relative to its largest magnitude,
+// at most half a quantization step.
+////////////////////////////////////////////////////////////////////////////////
+template <class QuantType, class IndexType, class ValueType>
+ValueType __quantize_row(const ValueType * values, const IndexType n, const IndexType step,
+                         QuantType * quantized, ValueType& scale)
+{
+    const ValueType max_quant = (ValueType) std::numeric_limits<QuantType>::max();
+
+    ValueType max_abs = 0;
+    for(IndexType k = 0; k < n; k++)
+        max_abs = std::max(max_abs, (ValueType) std::abs(values[k * step]));
+
+    scale = max_abs / max_quant;
+
+    ValueType max_error = 0;
+    for(IndexType k = 0; k < n; k++){
+        const ValueType v = (scale == 0) ? 0 : values[k * step] / scale;
+        const QuantType q = (QuantType) ((v < 0) ? -std::floor(-v + 0.5) : std::floor(v + 0.5));
+        quantized[k * step] = q;
+        max_error = std::max(max_error, (ValueType) std::abs(values[k * step] - q * scale));
+    }
+
+    return (max_abs == 0) ? 0 : max_error / max_abs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to quantized CSR format
+// Values are stored as QuantType (signed char or short) with one scale per
+// row.  If 'max_error' is given, it receives the largest rounding error of
+// any entry relative to the largest magnitude of its row.
+////////////////////////////////////////////////////////////////////////////////
+template <class QuantType, class IndexType, class ValueType>
+quantized_csr_matrix<IndexType, ValueType, QuantType>
+csr_to_quantized_csr(const csr_matrix<IndexType,ValueType>& csr, ValueType * max_error = NULL)
+{
+    quantized_csr_matrix<IndexType, ValueType, QuantType> qcsr;
+    qcsr.num_rows     = csr.num_rows;
+    qcsr.num_cols     = csr.num_cols;
+    qcsr.num_nonzeros = csr.num_nonzeros;
+
+    qcsr.Ap        = new_host_array<IndexType>(csr.num_rows + 1);
+    qcsr.Aj        = new_host_array<IndexType>(csr.num_nonzeros);
+    qcsr.Aq        = new_host_array<QuantType>(csr.num_nonzeros);
+    qcsr.row_scale = new_host_array<ValueType>(csr.num_rows);
+
+    ValueType error = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max:error)
+    for(IndexType i = 0; i < csr.num_rows; i++){
+        const IndexType row_start = csr.Ap[i];
+        const IndexType row_end   = csr.Ap[i+1];
+        qcsr.Ap[i] = row_start;
+        std::copy(csr.Aj + row_start, csr.Aj + row_end, qcsr.Aj + row_start);
+        error = std::max(error, __quantize_row(csr.Ax + row_start, row_end - row_start, (IndexType) 1, qcsr.Aq + row_start, qcsr.row_scale[i]));
+    }
+    qcsr.Ap[csr.num_rows] = csr.Ap[csr.num_rows];
+
+    if(max_error != NULL)
+        *max_error = error;
+
+    return qcsr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert quantized CSR format back to CSR format
+// Values are the quantized ones times their row scale, i.e. the matrix the
+// quantized kernels actually multiply by; csr_to_quantized_ell rounds every
+// row the same way, so this is the reference for quantized ELL too.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType, class QuantType>
+csr_matrix<IndexType, ValueType>
+quantized_csr_to_csr(const quantized_csr_matrix<IndexType,ValueType,QuantType>& qcsr)
+{
+    csr_matrix<IndexType, ValueType> csr;
+    csr.num_rows     = qcsr.num_rows;
+    csr.num_cols     = qcsr.num_cols;
+    csr.num_nonzeros = qcsr.num_nonzeros;
+
+    csr.Ap = new_host_array<IndexType>(qcsr.num_rows + 1);
+    csr.Aj = new_host_array<IndexType>(qcsr.num_nonzeros);
+    csr.Ax = new_host_array<ValueType>(qcsr.num_nonzeros);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < qcsr.num_rows; i++){
+        csr.Ap[i] = qcsr.Ap[i];
+        for(IndexType jj = qcsr.Ap[i]; jj < qcsr.Ap[i+1]; jj++){
+            csr.Aj[jj] = qcsr.Aj[jj];
+            csr.Ax[jj] = qcsr.Aq[jj] * qcsr.row_scale[i];
+        }
+    }
+    csr.Ap[qcsr.num_rows] = qcsr.Ap[qcsr.num_rows];
+
+    return csr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to quantized ELL format
+// The structure is that of csr_to_ell, including its rejection of matrices
+// with more than 'max_cols_per_row' columns in any row; values are quantized
+// per row as by csr_to_quantized_csr, and padding holds Aq 0.
+////////////////////////////////////////////////////////////////////////////////
+template <class QuantType, class IndexType, class ValueType>
+quantized_ell_matrix<IndexType, ValueType, QuantType>
+csr_to_quantized_ell(const csr_matrix<IndexType,ValueType>& csr, const IndexType max_cols_per_row, ValueType * max_error = NULL)
+{
+    ell_matrix<IndexType, ValueType> ell = csr_to_ell(csr, max_cols_per_row);
+
+    quantized_ell_matrix<IndexType, ValueType, QuantType> qell;
+    qell.num_rows         = ell.num_rows;
+    qell.num_cols         = ell.num_cols;
+    qell.num_nonzeros     = ell.num_nonzeros;
+    qell.stride           = ell.stride;
+    qell.num_cols_per_row = ell.num_cols_per_row;
+    qell.Aj               = ell.Aj;
+    qell.Aq               = NULL;
+    qell.row_scale        = NULL;
+
+    if(max_error != NULL)
+        *max_error = 0;
+
+    if(ell.Ax == NULL)
+        return qell;
+
+    const IndexType stride = ell.stride;
+    qell.Aq        = new_host_array<QuantType>(stride * ell.num_cols_per_row);
+    qell.row_scale = new_host_array<ValueType>(ell.num_rows);
+
+    ValueType error = 0;
+
+    // rows past num_rows are all padding and get no scale
+    #pragma omp parallel for schedule(static) reduction(max:error)
+    for(IndexType i = 0; i < stride; i++){
+        ValueType scale;
+        error = std::max(error, __quantize_row(ell.Ax + i, ell.num_cols_per_row, stride, qell.Aq + i, scale));
+        if(i < ell.num_rows)
+            qell.row_scale[i] = scale;
+    }
+
+    delete_host_array(ell.Ax);
+
+    if(max_error != NULL)
+        *max_error = error;
+
+    return qell;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert a CSR pattern to an ELL pattern
+// Same column limit as csr_to_ell: if any row has more than 
+// 'max_cols_per_row' entries an ell_pattern with 0 nonzeros is returned.
+// Unused slots are filled with the padding index (IndexType) -1.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+ell_pattern<IndexType>
+ csr_to_ell_pattern(const csr_pattern<IndexType>& csr, const IndexType max_cols_per_row, const IndexType alignment = 16)
+{
+    ell_pattern<IndexType> ell;
+
+    // compute maximum number of columns in any row
+    const IndexType num_cols_per_row = csr_max_row_length(csr.num_rows, csr.Ap);
+
+    ell.num_cols_per_row = num_cols_per_row;
+
+    if(num_cols_per_row > max_cols_per_row){
+        //too many columns
+        ell.Aj = NULL;
+        ell.num_rows = 0;
+        ell.num_cols = 0;
+        ell.num_nonzeros = 0;
+        ell.stride = 0;
+        return ell;
+    }
+
+    ell.num_rows     = csr.num_rows;
+    ell.num_cols     = csr.num_cols;
+    ell.num_nonzeros = csr.num_nonzeros;
+    ell.stride       = alignment * ((ell.num_rows + alignment - 1)/ alignment);
+
+    ell.Aj = new_host_array<IndexType>(ell.num_cols_per_row * ell.stride);
+
+    // same row-parallel fill as csr_to_ell
+    const IndexType stride = ell.stride;
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < stride; i++){
+        const IndexType row_start = (i < csr.num_rows) ? csr.Ap[i]   : 0;
+        const IndexType row_end   = (i < csr.num_rows) ? csr.Ap[i+1] : 0;
+
+        IndexType n = 0;
+        for(IndexType jj = row_start; jj < row_end; jj++, n++)
+            ell.Aj[stride * n + i] = csr.Aj[jj];
+        for(; n < num_cols_per_row; n++)
+            ell.Aj[stride * n + i] = (IndexType) -1;
+    }
+
+    return ell;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Expand an ELL pattern to an ELL matrix with unit values
+// Padding gets column 0 and value 0, as in csr_to_ell.
+////////////////////////////////////////////////////////////////////////////////
+template <class ValueType, class IndexType>
+ell_matrix<IndexType, ValueType> ell_pattern_to_ell(const ell_pattern<IndexType>& pattern)
+{
+    ell_matrix<IndexType, ValueType> ell;
+
+    ell.num_rows         = pattern.num_rows;
+    ell.num_cols         = pattern.num_cols;
+    ell.num_nonzeros     = pattern.num_nonzeros;
+    ell.stride           = pattern.stride;
+    ell.num_cols_per_row = pattern.num_cols_per_row;
+
+    const IndexType N = ell.stride * ell.num_cols_per_row;
+    ell.Aj = new_host_array<IndexType>(N);
+    ell.Ax = new_host_array<ValueType>(N);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType n = 0; n < N; n++){
+        const bool padding = pattern.Aj[n] == (IndexType) -1;
+        ell.Aj[n] = padding ? 0 : pattern.Aj[n];
+        ell.Ax[n] = padding ? 0 : 1;
+    }
+
+    return ell;
+}
+
+// order rows by decreasing length, ties by original position
+template <class IndexType>
+bool longer_row(const RowStr<IndexType>& a, const RowStr<IndexType>& b)
+{
+    return a.len > b.len || (a.len == b.len && a.orig_pos < b.orig_pos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to SELL-C-sigma (sliced ELL) format
+// Rows are sorted by decreasing length within each window of 'sort_window'
+// rows (ties keep their original order), then every slice of 'slice_size'
+// sorted rows is padded with zeros to the longest row of the slice only.
+// A sort window of 1 keeps the original row order; a window of num_rows
+// sorts the whole matrix.  Windows and slices are processed in parallel.
+// If the padded arrays cannot be indexed with IndexType, a sell_matrix with
+// dimensions (0,0) and 0 nonzeros is returned.
+//! @param csr           csr_matrix
+//! @param slice_size    rows per slice (C), the kernel's unit of coalescing
+//! @param sort_window   rows sorted together by length (sigma)
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+sell_matrix<IndexType, ValueType>
+ csr_to_sell(const csr_matrix<IndexType,ValueType>& csr, const IndexType slice_size = 32, const IndexType sort_window = 1024)
+{
+    sell_matrix<IndexType, ValueType> sell;
+
+    const IndexType num_rows = csr.num_rows;
+    const IndexType C = slice_size;
+
+    sell.num_rows     = csr.num_rows;
+    sell.num_cols     = csr.num_cols;
+    sell.num_nonzeros = csr.num_nonzeros;
+    sell.slice_size   = slice_size;
+    sell.sort_window  = sort_window;
+    sell.num_slices   = (num_rows + C - 1) / C;
+
+    // sort the rows by length within each window
+    RowStr<IndexType> * rows = new_host_array< RowStr<IndexType> >(num_rows);
+    const IndexType num_windows = (num_rows + sort_window - 1) / sort_window;
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType w = 0; w < num_windows; w++){
+        const IndexType begin = w * sort_window;
+        const IndexType end   = std::min(begin + sort_window, num_rows);
+        for(IndexType i = begin; i < end; i++){
+            rows[i].len      = csr.Ap[i+1] - csr.Ap[i];
+            rows[i].orig_pos = i;
+        }
+        if(sort_window > 1)
+            std::sort(rows + begin, rows + end, longer_row<IndexType>);
+    }
+
+    sell.row_perm  = new_host_array<IndexType>(num_rows);
+    sell.slice_ptr = new_host_array<IndexType>(sell.num_slices + 1);
+
+    // the width of each slice is the length of its longest row; the padded
+    // total is summed in 64 bits, as one long row times C can overflow IndexType
+    unsigned long long num_entries = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:num_entries)
+    for(IndexType s = 0; s < sell.num_slices; s++){
+        IndexType width = 0;
+        for(IndexType i = s * C; i < std::min(s * C + C, num_rows); i++){
+            sell.row_perm[i] = rows[i].orig_pos;
+            width = std::max(width, rows[i].len);
+        }
+        sell.slice_ptr[s] = width;
+        num_entries += (unsigned long long) width * C;
+    }
+    delete_host_array(rows);
+
+    if(num_entries > (unsigned long long) std::numeric_limits<IndexType>::max()){
+        // the padded arrays cannot be indexed with IndexType
+        delete_host_array(sell.row_perm);
+        delete_host_array(sell.slice_ptr);
+        sell.row_perm = sell.slice_ptr = sell.Aj = NULL;
+        sell.Ax = NULL;
+        sell.num_rows = 0;
+        sell.num_cols = 0;
+        sell.num_nonzeros = 0;
+        sell.num_slices = 0;
+        sell.num_entries = 0;
+        return sell;
+    }
+
+    // offsets in widths, then in entries; every offset is at most num_entries
+    sell.slice_ptr[sell.num_slices] = parallel_exclusive_scan(sell.slice_ptr, sell.num_slices);
+    #pragma omp parallel for schedule(static)
+    for(IndexType s = 0; s <= sell.num_slices; s++)
+        sell.slice_ptr[s] *= C;
+    sell.num_entries = (IndexType) num_entries;
+
+    sell.Aj = new_host_array<IndexType>(sell.num_entries);
+    sell.Ax = new_host_array<ValueType>(sell.num_entries);
+
+    // slices near the start of a window are the widest, so deal them out in turn
+    #pragma omp parallel for schedule(static,1)
+    for(IndexType s = 0; s < sell.num_slices; s++){
+        IndexType * Aj = sell.Aj + sell.slice_ptr[s];
+        ValueType * Ax = sell.Ax + sell.slice_ptr[s];
+        const IndexType width = (sell.slice_ptr[s+1] - sell.slice_ptr[s]) / C;
+
+        for(IndexType r = 0; r < C; r++){
+            const IndexType i = s * C + r;
+            const IndexType row_start = (i < num_rows) ? csr.Ap[sell.row_perm[i]]     : 0;
+            const IndexType row_end   = (i < num_rows) ? csr.Ap[sell.row_perm[i] + 1] : 0;
+
+            IndexType n = 0;
+            for(IndexType jj = row_start; jj < row_end; jj++, n++){
+                Aj[C * n + r] = csr.Aj[jj];
+                Ax[C * n + r] = csr.Ax[jj];
+            }
+            // pad out the tail of the row with zeros
+            for(; n < width; n++){
+                Aj[C * n + r] = 0;
+                Ax[C * n + r] = 0;
+            }
+        }
+    }
+
+    return sell;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to DIA format
+// Entry (i,j) lands on the diagonal with offset j - i; duplicate entries are
+// summed.  If the matrix has more than 'max_diagonals' diagonals, or the
+// diagonal arrays cannot be indexed with IndexType, then a dia_matrix with
+// dimensions (0,0) and 0 nonzeros is returned.
+//! @param csr           csr_matrix
+//! @param max_diagonals limit on the number of diagonals stored
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+dia_matrix<IndexType, ValueType>
+ csr_to_dia(const csr_matrix<IndexType,ValueType>& csr, const IndexType max_diagonals, const IndexType alignment = 32)
+{
+    dia_matrix<IndexType, ValueType> dia;
+
+    const IndexType num_rows = csr.num_rows;
+    const IndexType map_size = csr.num_rows + csr.num_cols;
+    const IndexType stride   = alignment * ((num_rows + alignment - 1)/ alignment);
+
+    // diag_map[j - i + num_rows] marks the diagonals in use, then numbers them;
+    // if num_rows + num_cols overflows IndexType the map is left empty and
+    // the matrix is rejected below
+    const bool map_fits = map_size >= num_rows;
+    const IndexType map_length = map_fits ? map_size : 0;
+    IndexType * diag_map = new_host_array<IndexType>(map_length);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType k = 0; k < map_length; k++)
+        diag_map[k] = 0;
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < (map_fits ? num_rows : 0); i++){
+        for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+            const IndexType k = csr.Aj[jj] + num_rows - i;
+            // a banded matrix marks the same few slots from every row, so
+            // read first to keep their cache lines shared
+            IndexType marked;
+            #pragma omp atomic read
+            marked = diag_map[k];
+            if(!marked){
+                #pragma omp atomic write
+                diag_map[k] = 1;
+            }
+        }
+    }
+
+    const IndexType num_diagonals = parallel_exclusive_scan(diag_map, map_length);
+
+    const unsigned long long num_values = (unsigned long long) stride * num_diagonals;
+    if(!map_fits || num_diagonals > max_diagonals || num_values > (unsigned long long) std::numeric_limits<IndexType>::max()){
+        //too many diagonals
+        delete_host_array(diag_map);
+        dia.diagonal_offsets = NULL;
+        dia.diagonal_data = NULL;
+        dia.num_rows = 0;
+        dia.num_cols = 0;
+        dia.num_nonzeros = 0;
+        dia.num_diagonals = 0;
+        dia.stride = 0;
+        return dia;
+    }
+
+    dia.num_rows      = csr.num_rows;
+    dia.num_cols      = csr.num_cols;
+    dia.num_nonzeros  = csr.num_nonzeros;
+    dia.num_diagonals = num_diagonals;
+    dia.stride        = stride;
+
+    dia.diagonal_offsets = new_host_array<long long>(num_diagonals);
+    dia.diagonal_data    = new_host_array<ValueType>((size_t) num_values);
+
+    // after the scan, slot k is in use if it numbers a diagonal of its own
+    #pragma omp parallel for schedule(static)
+    for(IndexType k = 0; k < map_length; k++){
+        const IndexType next = (k + 1 < map_length) ? diag_map[k + 1] : num_diagonals;
+        if(next != diag_map[k])
+            dia.diagonal_offsets[diag_map[k]] = (long long) k - (long long) num_rows;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < stride; i++){
+        for(IndexType n = 0; n < num_diagonals; n++)
+            dia.diagonal_data[(size_t) n * stride + i] = 0;
+        if(i >= num_rows)
+            continue;
+        for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+            const IndexType n = diag_map[csr.Aj[jj] + num_rows - i];
+            dia.diagonal_data[(size_t) n * stride + i] += csr.Ax[jj];
+        }
+    }
+
+    delete_host_array(diag_map);
+
+    return dia;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Count the nonzero block_size x block_size blocks of a CSR matrix
+// Blocks are aligned to multiples of block_size.  Every thread marks the
+// block columns seen in its current block row in a private num_cols array.
+//! @param csr           csr_matrix
+//! @param block_size    rows and columns per block
+//! @param counts        number of blocks in each block row, or NULL
+//! @returns             number of blocks
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+IndexType count_csr_blocks(const csr_matrix<IndexType,ValueType>& csr, const IndexType block_size, IndexType * counts = NULL)
+{
+    const IndexType num_block_rows = (csr.num_rows + block_size - 1) / block_size;
+    const IndexType num_block_cols = (csr.num_cols + block_size - 1) / block_size;
+    const int max_threads = histogram_num_threads(num_block_cols, csr.num_nonzeros);
+
+    IndexType num_blocks = 0;
+
+    #pragma omp parallel num_threads(max_threads) reduction(+:num_blocks)
+    {
+        // block row in which each block column was last seen
+        IndexType * last_row = new_host_array<IndexType>(num_block_cols);
+        std::fill(last_row, last_row + num_block_cols, (IndexType) -1);
+
+        #pragma omp for schedule(dynamic,64)
+        for(IndexType br = 0; br < num_block_rows; br++){
+            IndexType count = 0;
+            const IndexType row_end = std::min(br * block_size + block_size, csr.num_rows);
+            for(IndexType i = br * block_size; i < row_end; i++){
+                for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+                    const IndexType bc = csr.Aj[jj] / block_size;
+                    if(last_row[bc] != br){
+                        last_row[bc] = br;
+                        count++;
+                    }
+                }
+            }
+            if(counts != NULL)
+                counts[br] = count;
+            num_blocks += count;
+        }
+
+        delete_host_array(last_row);
+    }
+
+    return num_blocks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Block size that minimizes the matrix traffic of a block format
+// Each candidate is scored by the bytes of its stored blocks (explicit zeros
+// included) plus one index per block, against a value and an index per
+// nonzero for a scalar format.  Returns 1 when no block size is better.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+IndexType detect_block_size(const csr_matrix<IndexType,ValueType>& csr)
+{
+    const IndexType candidates[] = {2, 3, 4, 6};
+
+    IndexType best_size  = 1;
+    double    best_bytes = (double) csr.num_nonzeros * (sizeof(ValueType) + sizeof(IndexType));
+
+    for(size_t n = 0; n < sizeof(candidates) / sizeof(candidates[0]); n++){
+        const IndexType B = candidates[n];
+        const double num_blocks = (double) count_csr_blocks(csr, B);
+        const double bytes = num_blocks * (B * B * sizeof(ValueType) + sizeof(IndexType));
+        if(bytes < best_bytes){
+            best_size  = B;
+            best_bytes = bytes;
+        }
+    }
+
+    return best_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to block CSR format
+// Every block holding at least one entry is stored whole, with explicit
+// zeros.  Block columns are sorted within each block row and duplicate
+// entries are summed.
+//! @param csr           csr_matrix
+//! @param block_size    rows and columns per block
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+bcsr_matrix<IndexType, ValueType>
+ csr_to_bcsr(const csr_matrix<IndexType,ValueType>& csr, const IndexType block_size)
+{
+    bcsr_matrix<IndexType, ValueType> bcsr;
+
+    const IndexType B = block_size;
+    const IndexType num_block_rows = (csr.num_rows + B - 1) / B;
+    const IndexType num_block_cols = (csr.num_cols + B - 1) / B;
+
+    bcsr.num_rows       = csr.num_rows;
+    bcsr.num_cols       = csr.num_cols;
+    bcsr.num_nonzeros   = csr.num_nonzeros;
+    bcsr.block_size     = B;
+    bcsr.num_block_rows = num_block_rows;
+
+    bcsr.Ap = new_host_array<IndexType>(num_block_rows + 1);
+    count_csr_blocks(csr, B, bcsr.Ap);
+    bcsr.num_blocks = parallel_exclusive_scan(bcsr.Ap, num_block_rows);
+    bcsr.Ap[num_block_rows] = bcsr.num_blocks;
+
+    bcsr.Aj = new_host_array<IndexType>(bcsr.num_blocks);
+    bcsr.Ax = new_host_array<ValueType>((size_t) bcsr.num_blocks * B * B);
+
+    const int max_threads = histogram_num_threads(num_block_cols, csr.num_nonzeros);
+
+    #pragma omp parallel num_threads(max_threads)
+    {
+        // block row in which each block column was last seen, and its slot
+        IndexType * last_row = new_host_array<IndexType>(num_block_cols);
+        IndexType * position = new_host_array<IndexType>(num_block_cols);
+        std::fill(last_row, last_row + num_block_cols, (IndexType) -1);
+
+        #pragma omp for schedule(dynamic,64)
+        for(IndexType br = 0; br < num_block_rows; br++){
+            const IndexType row_begin = br * B;
+            const IndexType row_end   = std::min(row_begin + B, csr.num_rows);
+
+            IndexType n = bcsr.Ap[br];
+            for(IndexType i = row_begin; i < row_end; i++){
+                for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+                    const IndexType bc = csr.Aj[jj] / B;
+                    if(last_row[bc] != br){
+                        last_row[bc] = br;
+                        bcsr.Aj[n++] = bc;
+                    }
+                }
+            }
+
+            std::sort(bcsr.Aj + bcsr.Ap[br], bcsr.Aj + bcsr.Ap[br+1]);
+            for(IndexType p = bcsr.Ap[br]; p < bcsr.Ap[br+1]; p++)
+                position[bcsr.Aj[p]] = p;
+            std::fill(bcsr.Ax + (size_t) bcsr.Ap[br] * B * B, bcsr.Ax + (size_t) bcsr.Ap[br+1] * B * B, 0);
+
+            for(IndexType i = row_begin; i < row_end; i++){
+                for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+                    const IndexType col = csr.Aj[jj];
+                    const IndexType bc  = col / B;
+                    bcsr.Ax[(size_t) position[bc] * B * B + (i - row_begin) * B + (col - bc * B)] += csr.Ax[jj];
+                }
+            }
+        }
+
+        delete_host_array(last_row);
+        delete_host_array(position);
+    }
+
+    return bcsr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert block CSR format to block ELL format
+// If any block row has more than 'max_blocks_per_row' blocks, or the padded
+// arrays cannot be indexed with IndexType, then a bell_matrix with
+// dimensions (0,0) and 0 nonzeros is returned.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+bell_matrix<IndexType, ValueType>
+ bcsr_to_bell(const bcsr_matrix<IndexType,ValueType>& bcsr, const IndexType max_blocks_per_row, const IndexType alignment = 16)
+{
+    bell_matrix<IndexType, ValueType> bell;
+
+    const IndexType B = bcsr.block_size;
+    const IndexType num_block_rows = bcsr.num_block_rows;
+    const IndexType num_blocks_per_row = csr_max_row_length(num_block_rows, bcsr.Ap);
+    const IndexType stride = alignment * ((num_block_rows + alignment - 1)/ alignment);
+
+    bell.block_size         = B;
+    bell.num_blocks_per_row = num_blocks_per_row;
+
+    const unsigned long long num_values = (unsigned long long) stride * num_blocks_per_row * B * B;
+    if(num_blocks_per_row > max_blocks_per_row || num_values > (unsigned long long) std::numeric_limits<IndexType>::max()){
+        //too many blocks
+        bell.Aj = NULL;
+        bell.Ax = NULL;
+        bell.num_rows = 0;
+        bell.num_cols = 0;
+        bell.num_nonzeros = 0;
+        bell.num_block_rows = 0;
+        bell.num_blocks = 0;
+        bell.stride = 0;
+        return bell;
+    }
+
+    bell.num_rows       = bcsr.num_rows;
+    bell.num_cols       = bcsr.num_cols;
+    bell.num_nonzeros   = bcsr.num_nonzeros;
+    bell.num_block_rows = num_block_rows;
+    bell.num_blocks     = bcsr.num_blocks;
+    bell.stride         = stride;
+
+    bell.Aj = new_host_array<IndexType>((size_t) stride * num_blocks_per_row);
+    bell.Ax = new_host_array<ValueType>((size_t) num_values);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < stride; i++){
+        const IndexType block_start = (i < num_block_rows) ? bcsr.Ap[i]   : 0;
+        const IndexType block_end   = (i < num_block_rows) ? bcsr.Ap[i+1] : 0;
+
+        IndexType n = 0;
+        for(IndexType p = block_start; p < block_end; p++, n++){
+            bell.Aj[stride * n + i] = bcsr.Aj[p];
+            for(IndexType e = 0; e < B * B; e++)
+                bell.Ax[(n * B * B + e) * stride + i] = bcsr.Ax[(size_t) p * B * B + e];
+        }
+        // pad out the tail of the block row
+        for(; n < num_blocks_per_row; n++){
+            bell.Aj[stride * n + i] = (IndexType) -1;
+            for(IndexType e = 0; e < B * B; e++)
+                bell.Ax[(n * B * B + e) * stride + i] = 0;
+        }
+    }
+
+    return bell;
+}
+
+// entry of a CSB block, for sorting it into Z-Morton order
+template <typename ValueType>
+struct csb_entry
+{
+    unsigned short r, c;
+    ValueType v;
+};
+
+// whether the highest set bit of a is below the highest set bit of b
+inline bool less_msb(const unsigned int a, const unsigned int b)
+{
+    return a < b && a < (a ^ b);
+}
+
+// Z-Morton order with the row bit above the column bit at every level, so
+// the quadrants of any aligned sub-block are contiguous: 00, 01, 10, 11
+template <typename ValueType>
+bool morton_less(const csb_entry<ValueType>& a, const csb_entry<ValueType>& b)
+{
+    if(less_msb(a.r ^ b.r, a.c ^ b.c))
+        return a.c < b.c;
+    return a.r < b.r;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Block size of a CSB matrix with the given dimensions
+// About the square root of the larger dimension, so there are about as many
+// blocks as rows, rounded up to a power of two and capped at 65536 for the
+// 16-bit offsets inside a block.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+IndexType csb_block_size(const IndexType num_rows, const IndexType num_cols)
+{
+    const unsigned long long n = std::max(num_rows, num_cols);
+    unsigned long long beta = 1;
+    while(beta * beta < n && beta < 65536)
+        beta *= 2;
+    return (IndexType) beta;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to CSB (compressed sparse blocks) format
+// Entries are counted and scattered into their blocks one block row per
+// task, then every block is sorted into Z-Morton order.  If the block
+// pointers would outnumber the rows, columns and nonzeros together (a very
+// large matrix at the largest block size), then a csb_matrix with
+// dimensions (0,0) and 0 nonzeros is returned.
+//! @param csr           csr_matrix
+//! @param beta          rows and columns per block, a power of two up to
+//!                      65536, or 0 to use csb_block_size
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+csb_matrix<IndexType, ValueType>
+ csr_to_csb(const csr_matrix<IndexType,ValueType>& csr, IndexType beta = 0)
+{
+    csb_matrix<IndexType, ValueType> csb;
+
+    if(beta == 0)
+        beta = csb_block_size(csr.num_rows, csr.num_cols);
+    if(beta > 65536 || (beta & (beta - 1)) != 0){
+        printf("CSB block size %llu is not a power of two up to 65536\n", (unsigned long long) beta);
+        exit(1);
+    }
+
+    IndexType lg_beta = 0;
+    while(((IndexType) 1 << lg_beta) < beta)
+        lg_beta++;
+
+    const IndexType num_block_rows = (csr.num_rows + beta - 1) >> lg_beta;
+    const IndexType num_block_cols = (csr.num_cols + beta - 1) >> lg_beta;
+    const unsigned long long num_blocks = (unsigned long long) num_block_rows * num_block_cols;
+
+    if(num_blocks > 4 * ((unsigned long long) csr.num_rows + csr.num_cols + csr.num_nonzeros)){
+        //too many blocks
+        csb.blk_ptr = NULL;
+        csb.Ar = NULL;
+        csb.Ac = NULL;
+        csb.Ax = NULL;
+        csb.num_rows = 0;
+        csb.num_cols = 0;
+        csb.num_nonzeros = 0;
+        csb.beta = beta;
+        csb.num_block_rows = 0;
+        csb.num_block_cols = 0;
+        return csb;
+    }
+
+    csb.num_rows       = csr.num_rows;
+    csb.num_cols       = csr.num_cols;
+    csb.num_nonzeros   = csr.num_nonzeros;
+    csb.beta           = beta;
+    csb.num_block_rows = num_block_rows;
+    csb.num_block_cols = num_block_cols;
+
+    csb.blk_ptr = new_host_array<IndexType>((size_t) num_blocks + 1);
+    csb.Ar = new_host_array<unsigned short>(csr.num_nonzeros);
+    csb.Ac = new_host_array<unsigned short>(csr.num_nonzeros);
+    csb.Ax = new_host_array<ValueType>(csr.num_nonzeros);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType b = 0; b <= (IndexType) num_blocks; b++)
+        csb.blk_ptr[b] = 0;
+
+    // each block row is counted and filled by a single thread
+    #pragma omp parallel for schedule(dynamic,1)
+    for(IndexType br = 0; br < num_block_rows; br++){
+        IndexType * counts = csb.blk_ptr + (size_t) br * num_block_cols;
+        const IndexType row_end = (IndexType) std::min<unsigned long long>(csr.num_rows, (unsigned long long) (br + 1) << lg_beta);
+        for(IndexType i = br << lg_beta; i < row_end; i++)
+            for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++)
+                counts[csr.Aj[jj] >> lg_beta]++;
+    }
+
+    parallel_exclusive_scan(csb.blk_ptr, (size_t) num_blocks + 1);
+
+    IndexType * next = new_host_array<IndexType>((size_t) num_blocks);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType b = 0; b < (IndexType) num_blocks; b++)
+        next[b] = csb.blk_ptr[b];
+
+    #pragma omp parallel for schedule(dynamic,1)
+    for(IndexType br = 0; br < num_block_rows; br++){
+        IndexType * slot = next + (size_t) br * num_block_cols;
+        const IndexType row_end = (IndexType) std::min<unsigned long long>(csr.num_rows, (unsigned long long) (br + 1) << lg_beta);
+        for(IndexType i = br << lg_beta; i < row_end; i++){
+            for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++){
+                const IndexType j = csr.Aj[jj];
+                const IndexType n = slot[j >> lg_beta]++;
+                csb.Ar[n] = (unsigned short) (i & (beta - 1));
+                csb.Ac[n] = (unsigned short) (j & (beta - 1));
+                csb.Ax[n] = csr.Ax[jj];
+            }
+        }
+    }
+
+    delete_host_array(next);
+
+    #pragma omp parallel
+    {
+        std::vector< csb_entry<ValueType> > entries;
+
+        #pragma omp for schedule(dynamic,64)
+        for(IndexType b = 0; b < (IndexType) num_blocks; b++){
+            const IndexType block_start = csb.blk_ptr[b];
+            const IndexType block_end   = csb.blk_ptr[b+1];
+
+            entries.resize(block_end - block_start);
+            for(IndexType n = block_start; n < block_end; n++){
+                entries[n - block_start].r = csb.Ar[n];
+                entries[n - block_start].c = csb.Ac[n];
+                entries[n - block_start].v = csb.Ax[n];
+            }
+
+            std::sort(entries.begin(), entries.end(), morton_less<ValueType>);
+
+            for(IndexType n = block_start; n < block_end; n++){
+                csb.Ar[n] = entries[n - block_start].r;
+                csb.Ac[n] = entries[n - block_start].c;
+                csb.Ax[n] = entries[n - block_start].v;
+            }
+        }
+    }
+
+    return csb;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -187,6 +1219,107 @@ coo_matrix<IndexType, ValueType>
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//! Position of cell (x,y) along the Hilbert curve through an n x n grid
+// n is a power of two.  Each level picks the quadrant, then rotates and
+// mirrors the coordinates into that quadrant's orientation of the curve.
+////////////////////////////////////////////////////////////////////////////////
+inline unsigned long long hilbert_index(const unsigned long long n, unsigned long long x, unsigned long long y)
+{
+    unsigned long long d = 0;
+    for(unsigned long long s = n / 2; s > 0; s /= 2){
+        const unsigned long long rx = (x & s) ? 1 : 0;
+        const unsigned long long ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if(ry == 0){
+            if(rx == 1){
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// orders pairs by their first member only, so a stable sort keeps ties in order
+template <typename Pair>
+bool less_first(const Pair& a, const Pair& b)
+{
+    return a.first < b.first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert CSR format to COO format sorted along a Hilbert curve over tiles
+// The entries keep their CSR order inside each tile_size x tile_size tile,
+// and the tiles follow the curve, so each stretch of entries covers a compact
+// square of the matrix.  The sort uses all host threads.
+//! @param csr           csr_matrix
+//! @param tile_size     rows and columns per tile, a power of two
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+hilbert_coo_matrix<IndexType, ValueType>
+ csr_to_hilbert_coo(const csr_matrix<IndexType,ValueType>& csr, const IndexType tile_size = 512)
+{
+    if(tile_size == 0 || (tile_size & (tile_size - 1)) != 0){
+        printf("Hilbert tile size %llu is not a power of two\n", (unsigned long long) tile_size);
+        exit(1);
+    }
+
+    IndexType lg_tile = 0;
+    while(((IndexType) 1 << lg_tile) < tile_size)
+        lg_tile++;
+
+    // the curve covers a power-of-two grid of tiles
+    const unsigned long long num_tile_rows = ((unsigned long long) csr.num_rows + tile_size - 1) >> lg_tile;
+    const unsigned long long num_tile_cols = ((unsigned long long) csr.num_cols + tile_size - 1) >> lg_tile;
+    unsigned long long grid = 1;
+    while(grid < std::max(num_tile_rows, num_tile_cols))
+        grid *= 2;
+
+    coo_matrix<IndexType, ValueType> coo = csr_to_coo(csr);
+    const IndexType num_nonzeros = coo.num_nonzeros;
+
+    // (curve position, original position): a stable sort keeps CSR order in each tile
+    std::vector< std::pair<unsigned long long, IndexType> > order(num_nonzeros);
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType n = 0; n < num_nonzeros; n++){
+        order[n].first  = hilbert_index(grid, coo.I[n] >> lg_tile, coo.J[n] >> lg_tile);
+        order[n].second = n;
+    }
+
+    parallel_stable_sort(order.begin(), order.end(), less_first< std::pair<unsigned long long, IndexType> >);
+
+    hilbert_coo_matrix<IndexType, ValueType> hilbert;
+    hilbert.num_rows     = coo.num_rows;
+    hilbert.num_cols     = coo.num_cols;
+    hilbert.num_nonzeros = num_nonzeros;
+    hilbert.tile_size    = tile_size;
+
+    hilbert.I = new_host_array<IndexType>(num_nonzeros);
+    hilbert.J = new_host_array<IndexType>(num_nonzeros);
+    hilbert.V = new_host_array<ValueType>(num_nonzeros);
+
+    IndexType num_tiles = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:num_tiles)
+    for(IndexType n = 0; n < num_nonzeros; n++){
+        const IndexType src = order[n].second;
+        hilbert.I[n] = coo.I[src];
+        hilbert.J[n] = coo.J[src];
+        hilbert.V[n] = coo.V[src];
+        if(n == 0 || order[n].first != order[n - 1].first)
+            num_tiles++;
+    }
+
+    hilbert.num_tiles = num_tiles;
+
+    delete_host_matrix(coo);
+
+    return hilbert;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //! Convert COO format to CSR format
 // Storage for output is assumed to have been allocated
@@ -247,32 +1380,357 @@ void coo_to_csr(const IndexType * rows,
 
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Convert COOrdinate format (triplet) to CSR format
-//! @param coo        coo_matrix
+//! COO entries grouped by blocks of rows, see count_coo_rows
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+struct coo_row_blocks
+{
+    IndexType block_rows;           // rows in every block but the last
+    IndexType num_blocks;
+    int num_parts;
+    std::vector<size_t> offsets;    // start of the list of block b, part p at [b * num_parts + p]
+    IndexType * list;               // positions within their part of the entries of each block
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Count the entries of every row of a COO matrix using all host threads
+// The entries come in 'num_parts' consecutive parts, part p holding size[p]
+// entries at I[p], J[p].  Rows are cut into blocks of equal size, a few per
+// thread.  One thread per part lists, for every block, the positions of the
+// entries whose row (or, with 'mirror', whose column) lies in the block, and
+// the lists of each block are laid out part by part, so that walking them
+// visits the entries of the block in COO order.  Every block is then walked
+// by one thread, which counts the rows of the block alone.  A scatter that
+// walks the blocks the same way is conflict free and reproduces the entry
+// order of a serial pass.  Scratch is one index per listed entry plus one
+// offset per block and part, however many threads run.
+// With 'mirror' set, every off-diagonal entry (i,j) is also counted as (j,i).
+//! @param num_parts    number of parts of the entries
+//! @param I            row indices of each part
+//! @param J            column indices of each part
+//! @param size         number of entries in each part
+//! @param num_rows     number of rows of the matrix
+//! @param mirror       count the transpose of off-diagonal entries too
+//! @param blocks       the entry lists of every block, list freed by the caller
+//! @param row_lengths  number of entries in each row [num_rows]
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+void count_coo_rows(const int num_parts, const IndexType * const * I, const IndexType * const * J, const size_t * size,
+                    const IndexType num_rows, const bool mirror, coo_row_blocks<IndexType>& blocks, IndexType * row_lengths)
+{
+    const IndexType target = (IndexType) (4 * host_num_threads());
+
+    blocks.block_rows = std::max<IndexType>(1, num_rows / target + (num_rows % target != 0));
+    blocks.num_blocks = num_rows / blocks.block_rows + (num_rows % blocks.block_rows != 0);
+    blocks.num_parts  = num_parts;
+    blocks.offsets.assign((size_t) blocks.num_blocks * num_parts + 1, 0);
+
+    const IndexType block_rows = blocks.block_rows;
+    const IndexType num_blocks = blocks.num_blocks;
+    std::vector<size_t>& offsets = blocks.offsets;
+
+    // number of entries each part lists for each block
+    #pragma omp parallel for schedule(static,1)
+    for(int p = 0; p < num_parts; p++){
+        std::vector<size_t> count(num_blocks, 0);
+        for(size_t n = 0; n < size[p]; n++){
+            const IndexType b = I[p][n] / block_rows;
+            count[b]++;
+            if(mirror && J[p][n] / block_rows != b)
+                count[J[p][n] / block_rows]++;
+        }
+        for(IndexType b = 0; b < num_blocks; b++)
+            offsets[(size_t) b * num_parts + p + 1] = count[b];
+    }
+
+    for(size_t k = 0; k + 1 < offsets.size(); k++)
+        offsets[k + 1] += offsets[k];
+
+    blocks.list = new_host_array<IndexType>(offsets.back());
+    IndexType * list = blocks.list;
+
+    #pragma omp parallel for schedule(static,1)
+    for(int p = 0; p < num_parts; p++){
+        std::vector<size_t> next(num_blocks);
+        for(IndexType b = 0; b < num_blocks; b++)
+            next[b] = offsets[(size_t) b * num_parts + p];
+
+        for(size_t n = 0; n < size[p]; n++){
+            const IndexType b = I[p][n] / block_rows;
+            list[next[b]++] = (IndexType) n;
+            if(mirror && J[p][n] / block_rows != b)
+                list[next[J[p][n] / block_rows]++] = (IndexType) n;
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic,1)
+    for(IndexType b = 0; b < num_blocks; b++){
+        const IndexType first = b * block_rows;
+        const IndexType last  = (num_rows - first < block_rows) ? num_rows : first + block_rows;
+
+        std::fill(row_lengths + first, row_lengths + last, 0);
+        for(int p = 0; p < num_parts; p++){
+            for(size_t k = offsets[(size_t) b * num_parts + p]; k < offsets[(size_t) b * num_parts + p + 1]; k++){
+                const IndexType row = I[p][list[k]];
+                const IndexType col = J[p][list[k]];
+
+                if(row >= first && row < last)
+                    row_lengths[row]++;
+                if(mirror && row != col && col >= first && col < last)
+                    row_lengths[col]++;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert COO entries split into parts to CSR format using all host threads
+// The rows are counted by count_coo_rows, and every block of rows is then
+// scattered by the thread that walks its entry lists.  The result is that of
+// one serial pass over the parts in order.
+//! @param num_parts  number of parts of the entries
+//! @param I          row indices of each part
+//! @param J          column indices of each part
+//! @param V          values of each part
+//! @param size       number of entries in each part
+//! @param num_rows   number of rows of the matrix
+//! @param num_cols   number of columns of the matrix
+//! @param mirror     expand a symmetric matrix stored as one triangle
 ////////////////////////////////////////////////////////////////////////////////
 template <class IndexType, class ValueType>
 csr_matrix<IndexType, ValueType>
- coo_to_csr(const coo_matrix<IndexType,ValueType>& coo, bool compact = false){  
-
+ coo_parts_to_csr(const int num_parts, const IndexType * const * I, const IndexType * const * J, const ValueType * const * V,
+                  const size_t * size, const IndexType num_rows, const IndexType num_cols, const bool mirror)
+{
     csr_matrix<IndexType, ValueType> csr;
 
-    csr.num_rows     = coo.num_rows;
-    csr.num_cols     = coo.num_cols;
-    csr.num_nonzeros = coo.num_nonzeros;
+    csr.num_rows = num_rows;
+    csr.num_cols = num_cols;
+    csr.Ap = new_host_array<IndexType>(num_rows + 1);
+
+    coo_row_blocks<IndexType> blocks;
+    count_coo_rows(num_parts, I, J, size, num_rows, mirror, blocks, csr.Ap);
+
+    //cumsum the nnz per row to get Ap[]
+    csr.num_nonzeros = parallel_exclusive_scan(csr.Ap, num_rows);
+    csr.Ap[num_rows] = csr.num_nonzeros;
 
-    csr.Ap = new_host_array<IndexType>(csr.num_rows + 1);
     csr.Aj = new_host_array<IndexType>(csr.num_nonzeros);
     csr.Ax = new_host_array<ValueType>(csr.num_nonzeros);
 
-    coo_to_csr(coo.I, coo.J, coo.V,
-               coo.num_rows, coo.num_cols, coo.num_nonzeros,
-               csr.Ap, csr.Aj, csr.Ax);
+    const IndexType block_rows = blocks.block_rows;
+
+    //write Aj,Ax in the order of the COO entries, one block of rows per thread
+    #pragma omp parallel for schedule(dynamic,1)
+    for(IndexType b = 0; b < blocks.num_blocks; b++){
+        const IndexType first = b * block_rows;
+        const IndexType last  = (num_rows - first < block_rows) ? num_rows : first + block_rows;
+        const IndexType start = csr.Ap[first];
+
+        for(int p = 0; p < num_parts; p++){
+            for(size_t k = blocks.offsets[(size_t) b * num_parts + p]; k < blocks.offsets[(size_t) b * num_parts + p + 1]; k++){
+                const IndexType n   = blocks.list[k];
+                const IndexType row = I[p][n];
+                const IndexType col = J[p][n];
+
+                if(row >= first && row < last){
+                    const IndexType dest = csr.Ap[row]++;
+                    csr.Aj[dest] = col;
+                    csr.Ax[dest] = V[p][n];
+                }
+                if(mirror && row != col && col >= first && col < last){
+                    const IndexType dest = csr.Ap[col]++;
+                    csr.Aj[dest] = row;
+                    csr.Ax[dest] = V[p][n];
+                }
+            }
+        }
+
+        // Ap[i] now holds the end of row i, restore the starts of the block
+        for(IndexType i = last - 1; i > first; i--)
+            csr.Ap[i] = csr.Ap[i - 1];
+        csr.Ap[first] = start;
+    }
+
+    delete_host_array(blocks.list);
+
+    return csr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Split the entries of a COO matrix into one part per host thread
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+int split_coo_entries(const coo_matrix<IndexType,ValueType>& coo,
+                      std::vector<const IndexType *>& I, std::vector<const IndexType *>& J,
+                      std::vector<const ValueType *>& V, std::vector<size_t>& size)
+{
+    const int num_parts = host_num_threads();
+
+    I.resize(num_parts);
+    J.resize(num_parts);
+    V.resize(num_parts);
+    size.resize(num_parts);
+
+    for(int p = 0; p < num_parts; p++){
+        const size_t begin = ((size_t) coo.num_nonzeros *  p     ) / num_parts;
+        const size_t end   = ((size_t) coo.num_nonzeros * (p + 1)) / num_parts;
+        I[p] = coo.I + begin;
+        J[p] = coo.J + begin;
+        V[p] = coo.V + begin;
+        size[p] = end - begin;
+    }
+
+    return num_parts;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert COO format to CSR format using all host threads
+// The COO entries are split into one range per thread and converted by
+// coo_parts_to_csr, so the entries of each row keep their COO order.
+// With 'mirror' set, every off-diagonal entry (i,j) also produces (j,i):
+// the stored triangle of a symmetric matrix is expanded during conversion
+// rather than in a separate COO copy.
+//! @param coo        coo_matrix
+//! @param mirror     expand a symmetric matrix stored as one triangle
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+csr_matrix<IndexType, ValueType>
+ parallel_coo_to_csr(const coo_matrix<IndexType,ValueType>& coo, const bool mirror = false)
+{
+    std::vector<const IndexType *> I, J;
+    std::vector<const ValueType *> V;
+    std::vector<size_t> size;
+    const int num_parts = split_coo_entries(coo, I, J, V, size);
+
+    return coo_parts_to_csr(num_parts, &I[0], &J[0], &V[0], &size[0], coo.num_rows, coo.num_cols, mirror);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert COOrdinate format (triplet) to CSR format
+//! @param coo        coo_matrix
+//! @param compact    sum duplicate entries together and sort each row
+//! @param mirror     expand a symmetric matrix stored as one triangle
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+csr_matrix<IndexType, ValueType>
+ coo_to_csr(const coo_matrix<IndexType,ValueType>& coo, bool compact = false, bool mirror = false){  
+
+    csr_matrix<IndexType, ValueType> csr = parallel_coo_to_csr(coo, mirror);
     
     if (compact) {
-        //sum duplicates together
-        sum_csr_duplicates(csr.num_rows, csr.num_cols, csr.Ap, csr.Aj, csr.Ax);
+        //sum duplicates together, leaving the columns of each row sorted
+        sum_csr_duplicates(csr.num_rows, csr.num_cols, csr.Ap, csr.Aj, csr.Ax, true);
         csr.num_nonzeros = csr.Ap[csr.num_rows];
     }
 
     return csr;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert COO format to ELL format without an intermediate CSR matrix
+// The rows are counted by count_coo_rows, which also gives num_cols_per_row,
+// and every block of rows is then scattered straight into the column-major
+// ELL arrays by the thread that walks its entry lists.  The result is identical to
+// csr_to_ell(coo_to_csr(coo, false, mirror), max_cols_per_row, alignment).
+// If the matrix has more than 'max_cols_per_row' columns in any row, then 
+// an ell_matrix with dimensions (0,0) and 0 nonzeros is returned.
+//! @param coo               coo_matrix
+//! @param max_cols_per_row  longest row that ELL is built for
+//! @param mirror            expand a symmetric matrix stored as one triangle
+//! @param alignment         the stride is a multiple of this many rows
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+ell_matrix<IndexType, ValueType>
+ coo_to_ell(const coo_matrix<IndexType,ValueType>& coo, const IndexType max_cols_per_row, const bool mirror = false, const IndexType alignment = 16)
+{
+    ell_matrix<IndexType, ValueType> ell;
+
+    const IndexType num_rows = coo.num_rows;
+
+    std::vector<const IndexType *> I, J;
+    std::vector<const ValueType *> V;
+    std::vector<size_t> size;
+    const int num_parts = split_coo_entries(coo, I, J, V, size);
+
+    coo_row_blocks<IndexType> blocks;
+    IndexType * row_lengths = new_host_array<IndexType>(num_rows);
+    count_coo_rows(num_parts, &I[0], &J[0], &size[0], num_rows, mirror, blocks, row_lengths);
+
+    IndexType num_cols_per_row = 0;
+    IndexType num_nonzeros     = 0;
+    #pragma omp parallel for schedule(static) reduction(max:num_cols_per_row) reduction(+:num_nonzeros)
+    for(IndexType i = 0; i < num_rows; i++){
+        num_cols_per_row = std::max(num_cols_per_row, row_lengths[i]);
+        num_nonzeros += row_lengths[i];
+    }
+
+    ell.num_cols_per_row = num_cols_per_row;
+
+    if(num_cols_per_row > max_cols_per_row){
+        //too many columns
+        delete_host_array(blocks.list);
+        delete_host_array(row_lengths);
+        ell.Aj = NULL;
+        ell.Ax = NULL;
+        ell.num_rows = 0;
+        ell.num_cols = 0;
+        ell.num_nonzeros = 0;
+        ell.stride = 0;
+        return ell;
+    }
+
+    ell.num_rows     = coo.num_rows;
+    ell.num_cols     = coo.num_cols;
+    ell.num_nonzeros = num_nonzeros;
+    ell.stride       = alignment * ((ell.num_rows + alignment - 1)/ alignment);
+
+    ell.Aj = new_host_array<IndexType>(ell.num_cols_per_row * ell.stride);
+    ell.Ax = new_host_array<ValueType>(ell.num_cols_per_row * ell.stride);
+
+    const IndexType stride = ell.stride;
+
+    // pad out the tail of every row with zeros; the scatter fills the rest
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i < stride; i++){
+        for(IndexType n = (i < num_rows) ? row_lengths[i] : 0; n < num_cols_per_row; n++){
+            ell.Aj[stride * n + i] = 0;
+            ell.Ax[stride * n + i] = 0;
+        }
+    }
+
+    const IndexType block_rows = blocks.block_rows;
+
+    //write Aj,Ax in the order of the COO entries, one block of rows per thread
+    #pragma omp parallel for schedule(dynamic,1)
+    for(IndexType b = 0; b < blocks.num_blocks; b++){
+        const IndexType first = b * block_rows;
+        const IndexType last  = (num_rows - first < block_rows) ? num_rows : first + block_rows;
+
+        // count the rows of the block again as they are filled
+        std::fill(row_lengths + first, row_lengths + last, 0);
+        for(int p = 0; p < num_parts; p++){
+            for(size_t k = blocks.offsets[(size_t) b * num_parts + p]; k < blocks.offsets[(size_t) b * num_parts + p + 1]; k++){
+                const IndexType n   = blocks.list[k];
+                const IndexType row = I[p][n];
+                const IndexType col = J[p][n];
+
+                if(row >= first && row < last){
+                    const IndexType dest = stride * row_lengths[row]++ + row;
+                    ell.Aj[dest] = col;
+                    ell.Ax[dest] = V[p][n];
+                }
+                if(mirror && row != col && col >= first && col < last){
+                    const IndexType dest = stride * row_lengths[col]++ + col;
+                    ell.Aj[dest] = row;
+                    ell.Ax[dest] = V[p][n];
+                }
+            }
+        }
+    }
+
+    delete_host_array(blocks.list);
+    delete_host_array(row_lengths);
+
+    return ell;
+}
@@ -14,14 +14,24 @@
  *  limitations under the License.
  */
 #pragma once
+#include <limits>
 #include "mem.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Defines the following sparse matrix formats
 // ELL - ELLPACK/ITPACK
+// ELL-R - ELLPACK with row lengths
+// ELL16 - ELLPACK with 16-bit column offsets
+// SELL - Sliced ELLPACK (SELL-C-sigma)
+// DIA - Diagonal
+// BELL - Block ELLPACK
+// BCSR - Block Compressed Sparse Row
+// CSB - Compressed Sparse Blocks
 // CSR - Compressed Sparse Row
 // CSC - Compressed Sparse Column
 // COO - Coordinate
+// Hilbert COO - Coordinate, sorted along a Hilbert curve over tiles
+// Quantized ELL/CSR - integer values with a scale per row
 ////////////////////////////////////////////////////////////////////////////////
 
 template<typename IndexType>
@@ -31,6 +41,42 @@ struct matrix_shape
     IndexType num_rows, num_cols, num_nonzeros;
 };
 
+// Largest number of dense vectors multiplied by one SpMM call
+#define MAX_NUMVECTORS 32
+
+////////////////////////////////////////////////////////////////////////////////
+//! Whether a matrix of the given size needs 64-bit indices
+// 32-bit indices are kept as long as every offset the conversions and
+// kernels form fits in an unsigned int: entries of Aj/Ax, the padded ELL
+// arrays (at most 3 * num_nonzeros / num_rows + 1 columns, see csr_to_ell
+// callers) and the MAX_NUMVECTORS-wide blocks of x and y.
+////////////////////////////////////////////////////////////////////////////////
+inline bool needs_64bit_indices(const unsigned long long num_rows,
+                                const unsigned long long num_cols,
+                                const unsigned long long num_nonzeros)
+{
+    const unsigned long long limit  = std::numeric_limits<unsigned int>::max();
+    const unsigned long long stride = num_rows + 32;
+    const unsigned long long max_cols_per_row = (num_rows == 0) ? 1 : (3 * num_nonzeros) / num_rows + 1;
+
+    return 3 * num_nonzeros               > limit ||
+           stride * max_cols_per_row      > limit ||
+           stride * MAX_NUMVECTORS        > limit ||
+           (num_cols + 32) * MAX_NUMVECTORS > limit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Whether the sizes of a matrix are representable in IndexType
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType>
+bool fits_index_type(const unsigned long long num_rows,
+                     const unsigned long long num_cols,
+                     const unsigned long long num_nonzeros)
+{
+    const unsigned long long limit = std::numeric_limits<IndexType>::max();
+    return num_rows < limit && num_cols < limit && num_nonzeros < limit;
+}
+
 // ELLPACK/ITPACK matrix format
 template <typename IndexType, typename ValueType>
 struct ell_matrix : public matrix_shape<IndexType> 
@@ -45,6 +91,105 @@ struct ell_matrix : public matrix_shape<IndexType>
     ValueType * Ax;           //nonzero values stored in a (cols_per_row x stride) matrix
 };
 
+// ELL-R: ELL with the length of every row, so kernels stop at the end of
+// the row instead of testing every padded slot
+template <typename IndexType, typename ValueType>
+struct ellr_matrix : public ell_matrix<IndexType,ValueType>
+{
+    IndexType * Arl;          //number of used slots in each row [num_rows]
+};
+
+// Rows per block of an ELL16 matrix, one warp, so every thread of a warp
+// decodes its columns the same way
+#define ELL16_BLOCK_ROWS 32
+
+// ELL16: ELL with 16-bit column offsets
+// Rows are grouped in blocks of ELL16_BLOCK_ROWS.  A block whose columns span
+// at most 65536 stores its smallest column in block_base and the offset of
+// every column from it in Ajs, laid out as the ELL Aj.  A wider block has
+// block_base (IndexType) -1 and keeps full column indices in Aj: slot n of
+// row r of the block is at Aj[(wide_pos[b] * num_cols_per_row + n) * ELL16_BLOCK_ROWS + r].
+// Padding, as in ELL, has value zero.
+template <typename IndexType, typename ValueType>
+struct ell16_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType stride;
+    IndexType num_cols_per_row;
+    IndexType num_blocks;
+    IndexType num_wide_blocks;
+    IndexType num_wide_nonzeros;  //nonzeros in wide blocks
+
+    IndexType * block_base;       //smallest column of each block, or -1 if wide [num_blocks]
+    IndexType * wide_pos;         //position of each block among the wide ones [num_blocks]
+    unsigned short * Ajs;         //column offsets in a (cols_per_row x stride) matrix
+    IndexType * Aj;               //column indices of wide blocks [num_wide_blocks x cols_per_row x ELL16_BLOCK_ROWS]
+    ValueType * Ax;               //nonzero values stored in a (cols_per_row x stride) matrix
+};
+
+// Sliced ELLPACK (SELL-C-sigma) matrix format
+// Rows are sorted by decreasing length within windows of 'sort_window' rows
+// and cut into slices of 'slice_size' rows.  Each slice is an ELL matrix of
+// its own, padded only to its longest row: entry n of row r of slice s is
+// stored at slice_ptr[s] + n * slice_size + r.
+template <typename IndexType, typename ValueType>
+struct sell_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType slice_size;     //rows per slice (C)
+    IndexType sort_window;    //rows sorted together by length (sigma)
+    IndexType num_slices;
+    IndexType num_entries;    //length of Aj and Ax, padding included
+
+    IndexType * slice_ptr;    //offset of each slice in Aj/Ax [num_slices + 1]
+    IndexType * row_perm;     //original row of each sorted row [num_rows]
+    IndexType * Aj;           //column indices, each slice a (width x slice_size) matrix
+    ValueType * Ax;           //nonzero values, each slice a (width x slice_size) matrix
+};
+
+// DIAgonal matrix format
+// Entry (i, i + diagonal_offsets[n]) of diagonal n is stored at
+// diagonal_data[n * stride + i]; slots that fall outside the matrix or hold
+// no entry are zero.  Offsets are signed, so they do not follow IndexType.
+template <typename IndexType, typename ValueType>
+struct dia_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType stride;
+    IndexType num_diagonals;
+
+    long long * diagonal_offsets; //column minus row of each diagonal [num_diagonals]
+    ValueType * diagonal_data;    //values stored in a (num_diagonals x stride) matrix
+};
+
+// Block ELLPACK matrix format
+// ELL over dense block_size x block_size blocks: one column index per block.
+// Slot n of block row i holds block column Aj[n * stride + i] and the block
+// entry (r,c) at Ax[(n * block_size * block_size + r * block_size + c) * stride + i],
+// so consecutive block rows read consecutive values.  Unused slots hold the
+// block column (IndexType) -1 and always come after the used slots.
+template <typename IndexType, typename ValueType>
+struct bell_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType block_size;
+    IndexType num_block_rows;
+    IndexType num_blocks;         //stored blocks, padding excluded
+    IndexType stride;
+    IndexType num_blocks_per_row;
+
+    IndexType * Aj;           //block columns stored in a (blocks_per_row x stride) matrix
+    ValueType * Ax;           //block values stored in a (blocks_per_row x block_size^2 x stride) matrix
+};
+
 /*
  *  Compressed Sparse Row matrix (aka CRS)
  */
@@ -59,6 +204,45 @@ struct csr_matrix : public matrix_shape<IndexType>
     ValueType * Ax;  //nonzeros
 };
 
+// Block CSR matrix format: CSR over dense block_size x block_size blocks,
+// each block stored row-major
+template <typename IndexType, typename ValueType>
+struct bcsr_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType block_size;
+    IndexType num_block_rows;
+    IndexType num_blocks;
+
+    IndexType * Ap;  //block row pointer
+    IndexType * Aj;  //block column indices
+    ValueType * Ax;  //block values [num_blocks * block_size^2]
+};
+
+// Compressed Sparse Blocks (CSB) matrix format
+// The matrix is cut into beta x beta blocks, beta a power of two.  Block
+// (i,j) holds entries blk_ptr[i * num_block_cols + j] up to the offset of the
+// next block, each stored as its row and column inside the block and its
+// value, in Z-Morton order.  Block rows and block columns are equally cheap
+// to walk, so A*x and A^T*x both run from this one copy.
+template <typename IndexType, typename ValueType>
+struct csb_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType beta;               //rows and columns per block, at most 65536
+    IndexType num_block_rows;
+    IndexType num_block_cols;
+
+    IndexType * blk_ptr;          //offset of each block, row-major [num_block_rows * num_block_cols + 1]
+    unsigned short * Ar;          //row of each entry inside its block
+    unsigned short * Ac;          //column of each entry inside its block
+    ValueType * Ax;               //nonzero values
+};
+
 // COOrdinate matrix (aka IJV or Triplet format)
 template <typename IndexType, typename ValueType>
 struct coo_matrix : public matrix_shape<IndexType> 
@@ -71,6 +255,16 @@ struct coo_matrix : public matrix_shape<IndexType>
     ValueType * V;  //nonzero values
 };
 
+// COO matrix whose entries are sorted along a Hilbert curve over square
+// tile_size x tile_size tiles, in row-major order inside each tile, so that
+// consecutive entries touch nearby parts of x and y
+template <typename IndexType, typename ValueType>
+struct hilbert_coo_matrix : public coo_matrix<IndexType,ValueType>
+{
+    IndexType tile_size;      //rows and columns per tile, a power of two
+    IndexType num_tiles;      //tiles holding at least one entry
+};
+
 /*
  *  Hybrid ELL/COO format
  */
@@ -85,6 +279,67 @@ struct hyb_matrix : public matrix_shape<IndexType>
 };
 
 
+/*
+ *  Pattern-only matrices: the structure of a matrix whose nonzeros are all
+ *  one (e.g. a graph adjacency matrix), stored without Ax.
+ */
+// Unused ELL slots hold the column index (IndexType) -1 and always come
+// after the used slots of their row.
+template <typename IndexType>
+struct ell_pattern : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+
+    IndexType stride;
+    IndexType num_cols_per_row;
+
+    IndexType * Aj;           //column indices stored in a (cols_per_row x stride) matrix
+};
+
+template <typename IndexType>
+struct csr_pattern : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+
+    IndexType * Ap;  //row pointer
+    IndexType * Aj;  //column indices
+};
+
+
+/*
+ *  Quantized matrices: the values of every row are stored as integers of
+ *  QuantType (signed char or short) with one scale per row, so that
+ *  A[i,j] = Aq * row_scale[i].  ValueType is the type of the scales and of
+ *  the vectors.
+ */
+// Padding slots of the ELL layout hold Aq 0, as in ELL.
+template <typename IndexType, typename ValueType, typename QuantType>
+struct quantized_ell_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType stride;
+    IndexType num_cols_per_row;
+
+    IndexType * Aj;           //column indices stored in a (cols_per_row x stride) matrix
+    QuantType * Aq;           //quantized values stored in a (cols_per_row x stride) matrix
+    ValueType * row_scale;    //scale of each row [num_rows]
+};
+
+template <typename IndexType, typename ValueType, typename QuantType>
+struct quantized_csr_matrix : public matrix_shape<IndexType>
+{
+    typedef IndexType index_type;
+    typedef ValueType value_type;
+
+    IndexType * Ap;           //row pointer
+    IndexType * Aj;           //column indices
+    QuantType * Aq;           //quantized values
+    ValueType * row_scale;    //scale of each row [num_rows]
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //! sparse matrix memory management 
 ////////////////////////////////////////////////////////////////////////////////
@@ -94,16 +349,74 @@ void delete_ell_matrix(ell_matrix<IndexType,ValueType>& ell, const memory_locati
     delete_array(ell.Aj, loc);  delete_array(ell.Ax, loc);
 }
 
+template <typename IndexType, typename ValueType>
+void delete_ellr_matrix(ellr_matrix<IndexType,ValueType>& ellr, const memory_location loc){
+    delete_ell_matrix(ellr, loc);  delete_array(ellr.Arl, loc);
+}
+
+template <typename IndexType, typename ValueType>
+void delete_ell16_matrix(ell16_matrix<IndexType,ValueType>& ell16, const memory_location loc){
+    delete_array(ell16.block_base, loc);  delete_array(ell16.wide_pos, loc);
+    delete_array(ell16.Ajs, loc);  delete_array(ell16.Aj, loc);  delete_array(ell16.Ax, loc);
+}
+
+template <typename IndexType, typename ValueType>
+void delete_sell_matrix(sell_matrix<IndexType,ValueType>& sell, const memory_location loc){
+    delete_array(sell.slice_ptr, loc);  delete_array(sell.row_perm, loc);
+    delete_array(sell.Aj, loc);  delete_array(sell.Ax, loc);
+}
+
+template <typename IndexType, typename ValueType>
+void delete_dia_matrix(dia_matrix<IndexType,ValueType>& dia, const memory_location loc){
+    delete_array(dia.diagonal_offsets, loc);  delete_array(dia.diagonal_data, loc);
+}
+
+template <typename IndexType, typename ValueType>
+void delete_bell_matrix(bell_matrix<IndexType,ValueType>& bell, const memory_location loc){
+    delete_array(bell.Aj, loc);  delete_array(bell.Ax, loc);
+}
+
 template <typename IndexType, typename ValueType>
 void delete_csr_matrix(csr_matrix<IndexType,ValueType>& csr, const memory_location loc){
     delete_array(csr.Ap, loc);  delete_array(csr.Aj, loc);   delete_array(csr.Ax, loc);
 }
 
+template <typename IndexType, typename ValueType>
+void delete_bcsr_matrix(bcsr_matrix<IndexType,ValueType>& bcsr, const memory_location loc){
+    delete_array(bcsr.Ap, loc);  delete_array(bcsr.Aj, loc);   delete_array(bcsr.Ax, loc);
+}
+
+template <typename IndexType, typename ValueType>
+void delete_csb_matrix(csb_matrix<IndexType,ValueType>& csb, const memory_location loc){
+    delete_array(csb.blk_ptr, loc);
+    delete_array(csb.Ar, loc);  delete_array(csb.Ac, loc);  delete_array(csb.Ax, loc);
+}
+
 template <typename IndexType, typename ValueType>
 void delete_coo_matrix(coo_matrix<IndexType,ValueType>& coo, const memory_location loc){
     delete_array(coo.I, loc);   delete_array(coo.J, loc);   delete_array(coo.V, loc);
 }
 
+template <typename IndexType>
+void delete_ell_pattern(ell_pattern<IndexType>& ell, const memory_location loc){
+    delete_array(ell.Aj, loc);
+}
+
+template <typename IndexType>
+void delete_csr_pattern(csr_pattern<IndexType>& csr, const memory_location loc){
+    delete_array(csr.Ap, loc);  delete_array(csr.Aj, loc);
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_quantized_ell_matrix(quantized_ell_matrix<IndexType,ValueType,QuantType>& ell, const memory_location loc){
+    delete_array(ell.Aj, loc);  delete_array(ell.Aq, loc);  delete_array(ell.row_scale, loc);
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_quantized_csr_matrix(quantized_csr_matrix<IndexType,ValueType,QuantType>& csr, const memory_location loc){
+    delete_array(csr.Ap, loc);  delete_array(csr.Aj, loc);  delete_array(csr.Aq, loc);  delete_array(csr.row_scale, loc);
+}
+
 template <typename IndexType, typename ValueType>
 void delete_hyb_matrix(hyb_matrix<IndexType,ValueType>& hyb, const memory_location loc){
     delete_ell_matrix(hyb.ell, loc);
@@ -116,27 +429,90 @@ void delete_hyb_matrix(hyb_matrix<IndexType,ValueType>& hyb, const memory_locati
 template <typename IndexType, typename ValueType>
 void delete_host_matrix(ell_matrix<IndexType,ValueType>& ell){ delete_ell_matrix(ell, HOST_MEMORY); }
 
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(ellr_matrix<IndexType,ValueType>& ellr){ delete_ellr_matrix(ellr, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(ell16_matrix<IndexType,ValueType>& ell16){ delete_ell16_matrix(ell16, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(sell_matrix<IndexType,ValueType>& sell){ delete_sell_matrix(sell, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(dia_matrix<IndexType,ValueType>& dia){ delete_dia_matrix(dia, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(bell_matrix<IndexType,ValueType>& bell){ delete_bell_matrix(bell, HOST_MEMORY); }
+
 template <typename IndexType, typename ValueType>
 void delete_host_matrix(csr_matrix<IndexType,ValueType>& csr){ delete_csr_matrix(csr, HOST_MEMORY); }
 
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(bcsr_matrix<IndexType,ValueType>& bcsr){ delete_bcsr_matrix(bcsr, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(csb_matrix<IndexType,ValueType>& csb){ delete_csb_matrix(csb, HOST_MEMORY); }
+
 template <typename IndexType, typename ValueType>
 void delete_host_matrix(coo_matrix<IndexType,ValueType>& coo){ delete_coo_matrix(coo, HOST_MEMORY); }
 
+template <typename IndexType, typename ValueType>
+void delete_host_matrix(hilbert_coo_matrix<IndexType,ValueType>& coo){ delete_coo_matrix(coo, HOST_MEMORY); }
+
 template <class IndexType, class ValueType>
 void delete_host_matrix(hyb_matrix<IndexType,ValueType>& hyb){  delete_hyb_matrix(hyb, HOST_MEMORY); }
 
+template <typename IndexType>
+void delete_host_matrix(ell_pattern<IndexType>& ell){ delete_ell_pattern(ell, HOST_MEMORY); }
+
+template <typename IndexType>
+void delete_host_matrix(csr_pattern<IndexType>& csr){ delete_csr_pattern(csr, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_host_matrix(quantized_ell_matrix<IndexType,ValueType,QuantType>& ell){ delete_quantized_ell_matrix(ell, HOST_MEMORY); }
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_host_matrix(quantized_csr_matrix<IndexType,ValueType,QuantType>& csr){ delete_quantized_csr_matrix(csr, HOST_MEMORY); }
+
 ////////////////////////////////////////////////////////////////////////////////
 //! device functions
 ////////////////////////////////////////////////////////////////////////////////
 template <typename IndexType, typename ValueType>
 void delete_device_matrix(ell_matrix<IndexType,ValueType>& ell){ delete_ell_matrix(ell, DEVICE_MEMORY); }
 
+template <typename IndexType, typename ValueType>
+void delete_device_matrix(ellr_matrix<IndexType,ValueType>& ellr){ delete_ellr_matrix(ellr, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_device_matrix(ell16_matrix<IndexType,ValueType>& ell16){ delete_ell16_matrix(ell16, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_device_matrix(sell_matrix<IndexType,ValueType>& sell){ delete_sell_matrix(sell, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_device_matrix(dia_matrix<IndexType,ValueType>& dia){ delete_dia_matrix(dia, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType>
+void delete_device_matrix(bell_matrix<IndexType,ValueType>& bell){ delete_bell_matrix(bell, DEVICE_MEMORY); }
+
 template <typename IndexType, typename ValueType>
 void delete_device_matrix(csr_matrix<IndexType,ValueType>& csr){ delete_csr_matrix(csr, DEVICE_MEMORY); }
 
 template <class IndexType, class ValueType>
 void delete_device_matrix(hyb_matrix<IndexType,ValueType>& hyb){  delete_hyb_matrix(hyb, DEVICE_MEMORY); }
 
+template <typename IndexType>
+void delete_device_matrix(ell_pattern<IndexType>& ell){ delete_ell_pattern(ell, DEVICE_MEMORY); }
+
+template <typename IndexType>
+void delete_device_matrix(csr_pattern<IndexType>& csr){ delete_csr_pattern(csr, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_device_matrix(quantized_ell_matrix<IndexType,ValueType,QuantType>& ell){ delete_quantized_ell_matrix(ell, DEVICE_MEMORY); }
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void delete_device_matrix(quantized_csr_matrix<IndexType,ValueType,QuantType>& csr){ delete_quantized_csr_matrix(csr, DEVICE_MEMORY); }
+
 ////////////////////////////////////////////////////////////////////////////////
 //! copy to device
 ////////////////////////////////////////////////////////////////////////////////
@@ -150,6 +526,58 @@ ell_matrix<IndexType, ValueType> copy_matrix_to_device(const ell_matrix<IndexTyp
     return d_ell;
 }
 
+template <typename IndexType, typename ValueType>
+ellr_matrix<IndexType, ValueType> copy_matrix_to_device(const ellr_matrix<IndexType, ValueType>& h_ellr)
+{
+    ellr_matrix<IndexType, ValueType> d_ellr = h_ellr; //copy fields
+    d_ellr.Aj  = copy_array_to_device(h_ellr.Aj, h_ellr.stride * h_ellr.num_cols_per_row);
+    d_ellr.Ax  = copy_array_to_device(h_ellr.Ax, h_ellr.stride * h_ellr.num_cols_per_row);
+    d_ellr.Arl = copy_array_to_device(h_ellr.Arl, h_ellr.num_rows);
+    return d_ellr;
+}
+
+template <typename IndexType, typename ValueType>
+ell16_matrix<IndexType, ValueType> copy_matrix_to_device(const ell16_matrix<IndexType, ValueType>& h_ell16)
+{
+    ell16_matrix<IndexType, ValueType> d_ell16 = h_ell16; //copy fields
+    d_ell16.block_base = copy_array_to_device(h_ell16.block_base, h_ell16.num_blocks);
+    d_ell16.wide_pos   = copy_array_to_device(h_ell16.wide_pos,   h_ell16.num_blocks);
+    d_ell16.Ajs = copy_array_to_device(h_ell16.Ajs, h_ell16.stride * h_ell16.num_cols_per_row);
+    d_ell16.Aj  = copy_array_to_device(h_ell16.Aj,  h_ell16.num_wide_blocks * h_ell16.num_cols_per_row * ELL16_BLOCK_ROWS);
+    d_ell16.Ax  = copy_array_to_device(h_ell16.Ax,  h_ell16.stride * h_ell16.num_cols_per_row);
+    return d_ell16;
+}
+
+template <typename IndexType, typename ValueType>
+sell_matrix<IndexType, ValueType> copy_matrix_to_device(const sell_matrix<IndexType, ValueType>& h_sell)
+{
+    sell_matrix<IndexType, ValueType> d_sell = h_sell; //copy fields
+    d_sell.slice_ptr = copy_array_to_device(h_sell.slice_ptr, h_sell.num_slices + 1);
+    d_sell.row_perm  = copy_array_to_device(h_sell.row_perm,  h_sell.num_rows);
+    d_sell.Aj = copy_array_to_device(h_sell.Aj, h_sell.num_entries);
+    d_sell.Ax = copy_array_to_device(h_sell.Ax, h_sell.num_entries);
+    return d_sell;
+}
+
+template <typename IndexType, typename ValueType>
+dia_matrix<IndexType, ValueType> copy_matrix_to_device(const dia_matrix<IndexType, ValueType>& h_dia)
+{
+    dia_matrix<IndexType, ValueType> d_dia = h_dia; //copy fields
+    d_dia.diagonal_offsets = copy_array_to_device(h_dia.diagonal_offsets, h_dia.num_diagonals);
+    d_dia.diagonal_data    = copy_array_to_device(h_dia.diagonal_data, (size_t) h_dia.stride * h_dia.num_diagonals);
+    return d_dia;
+}
+
+
+template <typename IndexType, typename ValueType>
+bell_matrix<IndexType, ValueType> copy_matrix_to_device(const bell_matrix<IndexType, ValueType>& h_bell)
+{
+    const size_t block_area = (size_t) h_bell.block_size * h_bell.block_size;
+    bell_matrix<IndexType, ValueType> d_bell = h_bell; //copy fields
+    d_bell.Aj = copy_array_to_device(h_bell.Aj, (size_t) h_bell.stride * h_bell.num_blocks_per_row);
+    d_bell.Ax = copy_array_to_device(h_bell.Ax, (size_t) h_bell.stride * h_bell.num_blocks_per_row * block_area);
+    return d_bell;
+}
 
 template <typename IndexType, typename ValueType>
 csr_matrix<IndexType, ValueType> copy_matrix_to_device(const csr_matrix<IndexType, ValueType>& h_csr)
@@ -161,6 +589,54 @@ csr_matrix<IndexType, ValueType> copy_matrix_to_device(const csr_matrix<IndexTyp
     return d_csr;
 }
 
+template <typename IndexType, typename ValueType>
+coo_matrix<IndexType, ValueType> copy_matrix_to_device(const coo_matrix<IndexType, ValueType>& h_coo)
+{
+    coo_matrix<IndexType, ValueType> d_coo = h_coo; //copy fields
+    d_coo.I = copy_array_to_device(h_coo.I, h_coo.num_nonzeros);
+    d_coo.J = copy_array_to_device(h_coo.J, h_coo.num_nonzeros);
+    d_coo.V = copy_array_to_device(h_coo.V, h_coo.num_nonzeros);
+    return d_coo;
+}
+
+template <typename IndexType>
+ell_pattern<IndexType> copy_matrix_to_device(const ell_pattern<IndexType>& h_ell)
+{
+    ell_pattern<IndexType> d_ell = h_ell; //copy fields
+    d_ell.Aj = copy_array_to_device(h_ell.Aj, h_ell.stride * h_ell.num_cols_per_row);
+    return d_ell;
+}
+
+template <typename IndexType>
+csr_pattern<IndexType> copy_matrix_to_device(const csr_pattern<IndexType>& h_csr)
+{
+    csr_pattern<IndexType> d_csr = h_csr; //copy fields
+    d_csr.Ap = copy_array_to_device(h_csr.Ap, h_csr.num_rows + 1);
+    d_csr.Aj = copy_array_to_device(h_csr.Aj, h_csr.num_nonzeros);
+    return d_csr;
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+quantized_ell_matrix<IndexType, ValueType, QuantType> copy_matrix_to_device(const quantized_ell_matrix<IndexType, ValueType, QuantType>& h_ell)
+{
+    quantized_ell_matrix<IndexType, ValueType, QuantType> d_ell = h_ell; //copy fields
+    d_ell.Aj        = copy_array_to_device(h_ell.Aj, h_ell.stride * h_ell.num_cols_per_row);
+    d_ell.Aq        = copy_array_to_device(h_ell.Aq, h_ell.stride * h_ell.num_cols_per_row);
+    d_ell.row_scale = copy_array_to_device(h_ell.row_scale, h_ell.num_rows);
+    return d_ell;
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+quantized_csr_matrix<IndexType, ValueType, QuantType> copy_matrix_to_device(const quantized_csr_matrix<IndexType, ValueType, QuantType>& h_csr)
+{
+    quantized_csr_matrix<IndexType, ValueType, QuantType> d_csr = h_csr; //copy fields
+    d_csr.Ap        = copy_array_to_device(h_csr.Ap, h_csr.num_rows + 1);
+    d_csr.Aj        = copy_array_to_device(h_csr.Aj, h_csr.num_nonzeros);
+    d_csr.Aq        = copy_array_to_device(h_csr.Aq, h_csr.num_nonzeros);
+    d_csr.row_scale = copy_array_to_device(h_csr.row_scale, h_csr.num_rows);
+    return d_csr;
+}
+
 template <typename IndexType, typename ValueType>
 hyb_matrix<IndexType, ValueType> copy_matrix_to_device(const hyb_matrix<IndexType, ValueType>& h_hyb)
 {
@@ -16,29 +16,252 @@
 #pragma once
 
 #include "sparse_conversions.h"
+#include "mmap_file.h"
+#include "gzip_stream.h"
+#include "parallel.h"
+#include "timer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <ctype.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
 extern "C"{
 #include "mmio.h"
 }
 
-template <class IndexType,class ValueType>
-coo_matrix<IndexType,ValueType> read_coo_matrix(const char * mm_filename)
+////////////////////////////////////////////////////////////////////////////////
+//! Non-locale tokenizer for the body of a Matrix Market file
+// The routines below never read past 'end' and return NULL when the input is
+// malformed.  Unlike fscanf they do not consult the C locale, so several
+// threads can parse disjoint parts of a memory mapped file concurrently.
+////////////////////////////////////////////////////////////////////////////////
+
+const char * mm_skip_blanks(const char * p, const char * end)
 {
-    coo_matrix<IndexType,ValueType> coo;
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
 
-    FILE * fid;
-    MM_typecode matcode;
-    
-    fid = fopen(mm_filename, "r");
+// return the start of the line following the one containing p
+const char * mm_next_line(const char * p, const char * end)
+{
+    const char * newline = (const char *) memchr(p, '\n', end - p);
+    return (newline == NULL) ? end : newline + 1;
+}
 
-    if (fid == NULL){
-        printf("Unable to open file %s\n", mm_filename);
-        exit(1);
+// true if the line starting at p holds an entry (not blank, not a comment)
+bool mm_is_entry_line(const char * p, const char * end)
+{
+    p = mm_skip_blanks(p, end);
+    return p < end && *p != '\n' && *p != '%';
+}
+
+const char * mm_parse_index(const char * p, const char * end, unsigned long long& val)
+{
+    p = mm_skip_blanks(p, end);
+
+    const char * first = p;
+    unsigned long long v = 0;
+    while(p < end && *p >= '0' && *p <= '9'){
+        v = 10 * v + (*p - '0');
+        p++;
+    }
+
+    if(p == first)
+        return NULL;
+
+    val = v;
+    return p;
+}
+
+const char * mm_parse_real(const char * p, const char * end, double& val)
+{
+    // powers of ten that are exactly representable in a double
+    static const double exact_powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = mm_skip_blanks(p, end);
+    const char * first = p;
+
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')){
+        negative = (*p == '-');
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    int num_digits = 0;
+    bool truncated = false;
+
+    // integer part
+    for(; p < end && *p >= '0' && *p <= '9'; p++, num_digits++){
+        if(significant_digits < 19){
+            mantissa = 10 * mantissa + (*p - '0');
+            if(mantissa != 0) significant_digits++;
+        } else {
+            exponent++;
+            truncated = true;
+        }
+    }
+
+    // fractional part
+    if(p < end && *p == '.'){
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, num_digits++){
+            if(significant_digits < 19){
+                mantissa = 10 * mantissa + (*p - '0');
+                if(mantissa != 0) significant_digits++;
+                exponent--;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+
+    // exponent
+    if(num_digits > 0 && p < end && (*p == 'e' || *p == 'E' || *p == 'd' || *p == 'D')){
+        const char * q = p + 1;
+        bool negative_exponent = false;
+        if(q < end && (*q == '-' || *q == '+')){
+            negative_exponent = (*q == '-');
+            q++;
+        }
+        if(q < end && *q >= '0' && *q <= '9'){
+            int e = 0;
+            for(; q < end && *q >= '0' && *q <= '9'; q++)
+                if(e < 100000) e = 10 * e + (*q - '0');
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    bool is_separator = (p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n');
+
+    if(num_digits > 0 && is_separator && !truncated && mantissa <= (1ull << 53) &&
+       exponent >= -22 && exponent <= 22){
+        // fast path: mantissa and power of ten are both exact, so a single
+        // correctly rounded multiply or divide gives the correctly rounded result
+        double v = (double) mantissa;
+        if(exponent < 0)
+            v /= exact_powers[-exponent];
+        else
+            v *= exact_powers[exponent];
+        val = negative ? -v : v;
+        return p;
     }
 
+    // slow path (long mantissas, large exponents, inf/nan): defer to strtod
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+
+    char token[MM_MAX_TOKEN_LENGTH];
+    size_t length = p - first;
+    if(length == 0 || length >= MM_MAX_TOKEN_LENGTH)
+        return NULL;
+    memcpy(token, first, length);
+    token[length] = '\0';
+
+    char * token_end;
+    val = strtod(token, &token_end);
+    if(token_end != token + length)
+        return NULL;
+
+    return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Count the entries in [begin,end), which must start at the beginning of a line
+////////////////////////////////////////////////////////////////////////////////
+size_t mm_count_entries(const char * begin, const char * end)
+{
+    size_t count = 0;
+    for(const char * p = begin; p < end; p = mm_next_line(p, end))
+        if(mm_is_entry_line(p, end))
+            count++;
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Parse the entry on the line starting at p
+// Indices are converted from 1-based to 0-based and checked against the
+// matrix shape.  The value is only parsed if 'parse_value' is set, otherwise
+// it is left untouched.  Returns false if the line could not be parsed.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+bool mm_parse_entry(const char * p, const char * end, const bool parse_value,
+                    const IndexType num_rows, const IndexType num_cols,
+                    IndexType& row, IndexType& col, double& val)
+{
+    unsigned long long i, j;
+
+    if((p = mm_parse_index(p, end, i)) == NULL) return false;
+    if((p = mm_parse_index(p, end, j)) == NULL) return false;
+    if(parse_value && (p = mm_parse_real(p, end, val)) == NULL) return false;
+
+    if(i < 1 || i > (unsigned long long) num_rows ||
+       j < 1 || j > (unsigned long long) num_cols)
+        return false;
+
+    row = (IndexType) (i - 1);  //adjust from 1-based to 0-based indexing
+    col = (IndexType) (j - 1);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Parse the coordinate entries in [begin,end) into I, J and V
+// Pattern entries receive the value 1.0.  Returns false if a line could not
+// be parsed.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+bool mm_parse_entries(const char * begin, const char * end, const bool pattern,
+                      const IndexType num_rows, const IndexType num_cols,
+                      IndexType * I, IndexType * J, ValueType * V)
+{
+    size_t n = 0;
+    for(const char * p = begin; p < end; p = mm_next_line(p, end)){
+        if(!mm_is_entry_line(p, end))
+            continue;
+
+        double val = 1.0;
+        if(!mm_parse_entry(p, end, !pattern, num_rows, num_cols, I[n], J[n], val))
+            return false;
+        V[n] = (ValueType) val;
+        n++;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Split [body,body_end) into num_chunks newline-aligned chunks
+// chunk[c] and chunk[c+1] delimit chunk c; chunk has num_chunks + 1 entries.
+// With fewer bytes than chunks, the leading chunks are empty.
+////////////////////////////////////////////////////////////////////////////////
+void mm_split_chunks(const char * body, const char * body_end, const int num_chunks, const char ** chunk)
+{
+    chunk[0] = body;
+    for(int c = 1; c < num_chunks; c++){
+        const size_t offset = (size_t) (body_end - body) * c / num_chunks;
+        // a chunk boundary at 'body' is already the start of a line
+        chunk[c] = (offset == 0) ? body : mm_next_line(body + offset - 1, body_end);
+    }
+    chunk[num_chunks] = body_end;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the banner and size line of a Matrix Market file
+// Exits if the file is not a supported sparse matrix.  Returns the offset
+// of the first entry.
+////////////////////////////////////////////////////////////////////////////////
+long mm_read_header(FILE * fid, const char * mm_filename, MM_typecode& matcode,
+                    long long& num_rows, long long& num_cols, long long& num_nonzeros)
+{
     if (mm_read_banner(fid, &matcode) != 0){
         printf("Could not process Matrix Market banner.\n");
         exit(1);
@@ -56,10 +279,217 @@ coo_matrix<IndexType,ValueType> read_coo_matrix(const char * mm_filename)
         exit(1);
     }
 
-    int num_rows, num_cols, num_nonzeros;
-    if ( mm_read_mtx_crd_size(fid,&num_rows,&num_cols,&num_nonzeros) !=0)
+    if ( mm_read_mtx_crd_size64(fid,&num_rows,&num_cols,&num_nonzeros) !=0)
             exit(1);
 
+    if (num_rows < 0 || num_cols < 0 || num_nonzeros < 0){
+        printf("Invalid matrix size in %s\n", mm_filename);
+        exit(1);
+    }
+
+    // the body of the file starts right after the size line
+    return ftell(fid);
+}
+
+// Length of the banner, comments and size line at the start of 'data', or 0
+// if the size line is not complete yet
+size_t mm_header_length(const char * data, const size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    const char * end = data + size;
+    const char * p = mm_next_line(data, end);   //banner
+
+    while (p < end){
+        const char * line = p;
+        p = mm_next_line(p, end);
+        if (p == end && p[-1] != '\n')
+            return 0;
+        if (*line == '%')
+            continue;
+        for (const char * c = line; c < p; c++)
+            if (!isspace((unsigned char) *c))
+                return p - data;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the header of a compressed Matrix Market file from its block reader
+// Blocks are appended to 'buffer' until it holds the whole header; the
+// entries start at the returned offset of 'buffer'.
+////////////////////////////////////////////////////////////////////////////////
+long mm_read_header(gzip_block_reader& reader, const char * mm_filename, MM_typecode& matcode,
+                    long long& num_rows, long long& num_cols, long long& num_nonzeros,
+                    std::vector<char>& buffer)
+{
+    std::vector<char> block;
+    size_t header_length = 0;
+    while ((header_length = mm_header_length(buffer.data(), buffer.size())) == 0 && reader.next(block))
+        buffer.insert(buffer.end(), block.begin(), block.end());
+
+    if (header_length == 0){
+        printf("Could not process Matrix Market banner.\n");
+        exit(1);
+    }
+
+    // the mmio routines parse the header from a FILE over the buffer
+    FILE * fid = fmemopen(buffer.data(), header_length, "r");
+    const long body_offset = mm_read_header(fid, mm_filename, matcode, num_rows, num_cols, num_nonzeros);
+    fclose(fid);
+
+    return body_offset;
+}
+
+long mm_read_header(const char * mm_filename, MM_typecode& matcode,
+                    long long& num_rows, long long& num_cols, long long& num_nonzeros)
+{
+    if (is_gzip_file(mm_filename)){
+        // small blocks: only the first few are decompressed
+        gzip_block_reader reader(mm_filename, 1 << 16);
+        std::vector<char> buffer;
+        return mm_read_header(reader, mm_filename, matcode, num_rows, num_cols, num_nonzeros, buffer);
+    }
+
+    FILE * fid;
+    
+    fid = fopen(mm_filename, "r");
+
+    if (fid == NULL){
+        printf("Unable to open file %s\n", mm_filename);
+        exit(1);
+    }
+
+    const long body_offset = mm_read_header(fid, mm_filename, matcode, num_rows, num_cols, num_nonzeros);
+    fclose(fid);
+
+    return body_offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Parse the entries in [begin,end) into coo, starting at entry 'offset'
+// The range is split into newline-aligned chunks, one per thread.  Every
+// chunk is counted first so that each thread knows where its entries go.
+// Returns the number of entries parsed.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType,class ValueType>
+size_t mm_parse_range(const char * mm_filename, const char * begin, const char * end,
+                      const bool pattern, coo_matrix<IndexType,ValueType>& coo, const size_t offset)
+{
+    const int num_chunks = host_num_threads();
+    const char ** chunk = new_host_array<const char *>(num_chunks + 1);
+    size_t * chunk_offset = new_host_array<size_t>(num_chunks + 1);
+
+    mm_split_chunks(begin, end, num_chunks, chunk);
+
+    // count the entries in each chunk to find where its output begins
+    #pragma omp parallel for schedule(static,1)
+    for(int c = 0; c < num_chunks; c++)
+        chunk_offset[c + 1] = mm_count_entries(chunk[c], chunk[c + 1]);
+
+    chunk_offset[0] = offset;
+    for(int c = 0; c < num_chunks; c++)
+        chunk_offset[c + 1] += chunk_offset[c];
+
+    if (chunk_offset[num_chunks] > (size_t) coo.num_nonzeros){
+        printf("\nExpected %llu entries but found more\n", (unsigned long long) coo.num_nonzeros);
+        exit(1);
+    }
+
+    // parse every chunk directly into its slice of I, J and V
+    bool parse_error = false;
+    #pragma omp parallel for schedule(static,1) reduction(||:parse_error)
+    for(int c = 0; c < num_chunks; c++){
+        const size_t chunk_begin = chunk_offset[c];
+        if (!mm_parse_entries(chunk[c], chunk[c + 1], pattern,
+                              coo.num_rows, coo.num_cols,
+                              coo.I + chunk_begin, coo.J + chunk_begin, coo.V + chunk_begin))
+            parse_error = true;
+    }
+
+    if (parse_error){
+        printf("\nUnable to parse the entries of %s\n", mm_filename);
+        exit(1);
+    }
+
+    const size_t num_entries = chunk_offset[num_chunks] - offset;
+
+    delete_host_array(chunk);
+    delete_host_array(chunk_offset);
+
+    return num_entries;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Parse the entries of a compressed Matrix Market file block by block
+// 'buffer' holds the header and any entries read with it.  Each block is
+// parsed up to its last complete line while the reader's thread inflates
+// the next one; the partial line is carried over.  Returns the number of
+// entries parsed; 'num_bytes' is set to the decompressed size of the body.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType,class ValueType>
+size_t mm_parse_stream(gzip_block_reader& reader, const char * mm_filename, std::vector<char>& buffer,
+                       const long body_offset, const bool pattern, coo_matrix<IndexType,ValueType>& coo,
+                       size_t& num_bytes)
+{
+    std::vector<char> block;
+    size_t num_entries = 0;
+    num_bytes = 0;
+
+    buffer.erase(buffer.begin(), buffer.begin() + body_offset);
+
+    for(;;){
+        const bool more = reader.next(block);
+        buffer.insert(buffer.end(), block.begin(), block.end());
+
+        // everything up to the last newline can be parsed now
+        size_t n = buffer.size();
+        if (more)
+            while (n > 0 && buffer[n - 1] != '\n')
+                n--;
+
+        if (n > 0){
+            num_entries += mm_parse_range(mm_filename, buffer.data(), buffer.data() + n, pattern, coo, num_entries);
+            num_bytes += n;
+            buffer.erase(buffer.begin(), buffer.begin() + n);
+        }
+
+        if (!more)
+            break;
+    }
+
+    return num_entries;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read a Matrix Market file into COO format
+// Symmetric matrices are expanded to both triangles, unless 'is_symmetric'
+// is given: then the stored triangle is returned as is and *is_symmetric
+// tells the caller whether it still has to be mirrored.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType,class ValueType>
+coo_matrix<IndexType,ValueType> read_coo_matrix(const char * mm_filename, bool * is_symmetric = NULL)
+{
+    coo_matrix<IndexType,ValueType> coo;
+
+    // gzip input (.mtx.gz or .tar.gz) is inflated on a separate thread
+    gzip_block_reader * reader = is_gzip_file(mm_filename) ? new gzip_block_reader(mm_filename) : NULL;
+    std::vector<char> buffer;
+
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    const long body_offset = (reader != NULL) ?
+        mm_read_header(*reader, mm_filename, matcode, num_rows, num_cols, num_nonzeros, buffer) :
+        mm_read_header(mm_filename, matcode, num_rows, num_cols, num_nonzeros);
+
+    // a symmetric file expands to at most twice its stored entries
+    const long long max_nonzeros = mm_is_symmetric(matcode) ? 2 * num_nonzeros : num_nonzeros;
+    if (!fits_index_type<IndexType>(num_rows, num_cols, max_nonzeros)){
+        printf("%s is too large for %d-bit indices\n", mm_filename, (int) (8 * sizeof(IndexType)));
+        exit(1);
+    }
+
     coo.num_rows     = (IndexType) num_rows;
     coo.num_cols     = (IndexType) num_cols;
     coo.num_nonzeros = (IndexType) num_nonzeros;
@@ -71,75 +501,576 @@ coo_matrix<IndexType,ValueType> read_coo_matrix(const char * mm_filename)
     printf("Reading sparse matrix from file (%s):",mm_filename);
     fflush(stdout);
 
-    if (mm_is_pattern(matcode)){
-        // pattern matrix defines sparsity pattern, but not values
-        for( IndexType i = 0; i < coo.num_nonzeros; i++ ){
-            assert(fscanf(fid, " %d %d \n", &(coo.I[i]), &(coo.J[i])) == 2);
-            coo.I[i]--;      //adjust from 1-based to 0-based indexing
-            coo.J[i]--;
-            coo.V[i] = 1.0;  //use value 1.0 for all nonzero entries 
-        }
-    } else if (mm_is_real(matcode) || mm_is_integer(matcode)){
-        for( IndexType i = 0; i < coo.num_nonzeros; i++ ){
-            IndexType I,J;
-            double V;  // always read in a double and convert later if necessary
-            
-            assert(fscanf(fid, " %d %d %lf \n", &I, &J, &V) == 3);
-
-            coo.I[i] = (IndexType) I - 1; 
-            coo.J[i] = (IndexType) J - 1;
-            coo.V[i] = (ValueType)  V;
-        }
+    host_timer t;
+
+    size_t num_entries, num_bytes;
+    if (reader != NULL){
+        num_entries = mm_parse_stream(*reader, mm_filename, buffer, body_offset, mm_is_pattern(matcode), coo, num_bytes);
+        delete reader;
     } else {
-        printf("Unrecognized data type\n");
+        mapped_file file = map_file(mm_filename);
+        const char * body     = file.data + body_offset;
+        const char * body_end = file.data + file.size;
+
+        num_entries = mm_parse_range(mm_filename, body, body_end, mm_is_pattern(matcode), coo, 0);
+        num_bytes = body_end - body;
+
+        unmap_file(file);
+    }
+
+    if (num_entries != (size_t) coo.num_nonzeros){
+        printf("\nExpected %llu entries but found %llu\n", (unsigned long long) coo.num_nonzeros, (unsigned long long) num_entries);
         exit(1);
     }
 
-    fclose(fid);
-    printf(" done\n");
+    const double seconds = t.seconds_elapsed();
+    const double megabytes = num_bytes / 1e6;
+
+    printf(" done (%.1f MB/s)\n", (seconds == 0) ? 0.0 : megabytes / seconds);
+
+    if( is_symmetric != NULL ){
+        // the caller mirrors the stored triangle itself (e.g. in coo_to_csr)
+        *is_symmetric = mm_is_symmetric(matcode);
+    } else if( mm_is_symmetric(matcode) ){ //duplicate off diagonal entries
+        expand_symmetric_coo(coo);
+    }
+
+    return coo;
+}
+
+template <class IndexType, class ValueType>
+csr_matrix<IndexType,ValueType> read_csr_matrix(const char * mm_filename, bool compact = false)
+{
+    bool symmetric = false;
+    coo_matrix<IndexType,ValueType> coo = read_coo_matrix<IndexType,ValueType>(mm_filename, &symmetric); 
+
+    // the stored triangle of a symmetric matrix is mirrored during conversion
+    csr_matrix<IndexType,ValueType> csr = coo_to_csr(coo, compact, symmetric);
+
+    delete_host_matrix(coo);
+
+    return csr;
+}
+
 
-    if( mm_is_symmetric(matcode) ){ //duplicate off diagonal entries
-        IndexType off_diagonals = 0;
-        for( IndexType i = 0; i < coo.num_nonzeros; i++ ){
-            if( coo.I[i] != coo.J[i] )
-                off_diagonals++;
+////////////////////////////////////////////////////////////////////////////////
+//! Read a Matrix Market file directly into CSR format without a COO copy
+// Two passes over the memory mapped file: the first counts the entries of
+// every row (mirrored entries of symmetric matrices included), the second
+// scatters each entry straight into the preallocated Aj/Ax, with Ap used as
+// the per-row write cursor.  Peak memory is the CSR matrix itself.
+// Threads scatter into a row in no particular order, so the columns of each
+// row are sorted afterwards to make the result deterministic.
+// Without 'read_values' the values are never parsed and csr.Ax is NULL.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void read_csr_streaming(const char * mm_filename, csr_matrix<IndexType,ValueType>& csr, const bool read_values)
+{
+    if (is_gzip_file(mm_filename)){
+        // compressed input cannot be mapped for two passes: go through COO
+        csr = read_csr_matrix<IndexType,ValueType>(mm_filename);
+        if (read_values){
+            sort_csr_columns(csr);
+        } else {
+            delete_host_array(csr.Ax);
+            csr.Ax = NULL;
+            sort_csr_columns(csr.num_rows, csr.Ap, csr.Aj);
         }
+        return;
+    }
 
-        IndexType true_nonzeros = 2*off_diagonals + (coo.num_nonzeros - off_diagonals);
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    const long body_offset = mm_read_header(mm_filename, matcode, num_rows, num_cols, num_nonzeros);
 
-        IndexType* new_I = new_host_array<IndexType>(true_nonzeros);
-        IndexType* new_J = new_host_array<IndexType>(true_nonzeros);
-        ValueType * new_V = new_host_array<ValueType>(true_nonzeros);
+    // a symmetric file expands to at most twice its stored entries
+    const long long max_nonzeros = mm_is_symmetric(matcode) ? 2 * num_nonzeros : num_nonzeros;
+    if (!fits_index_type<IndexType>(num_rows, num_cols, max_nonzeros)){
+        printf("%s is too large for %d-bit indices\n", mm_filename, (int) (8 * sizeof(IndexType)));
+        exit(1);
+    }
 
-        IndexType ptr = 0;
-        for( IndexType i = 0; i < coo.num_nonzeros; i++ ){
-            if( coo.I[i] != coo.J[i] ){
-                new_I[ptr] = coo.I[i];  new_J[ptr] = coo.J[i];  new_V[ptr] = coo.V[i];
-                ptr++;
-                new_J[ptr] = coo.I[i];  new_I[ptr] = coo.J[i];  new_V[ptr] = coo.V[i];
-                ptr++;
-            } else {
-                new_I[ptr] = coo.I[i];  new_J[ptr] = coo.J[i];  new_V[ptr] = coo.V[i];
-                ptr++;
+    const bool pattern   = mm_is_pattern(matcode);
+    const bool symmetric = mm_is_symmetric(matcode);
+
+    csr.num_rows = (IndexType) num_rows;
+    csr.num_cols = (IndexType) num_cols;
+
+    printf("Reading sparse matrix from file (%s):",mm_filename);
+    fflush(stdout);
+
+    host_timer t;
+
+    mapped_file file = map_file(mm_filename);
+    const char * body     = file.data + body_offset;
+    const char * body_end = file.data + file.size;
+
+    const int num_chunks = host_num_threads();
+    const char ** chunk = new_host_array<const char *>(num_chunks + 1);
+    mm_split_chunks(body, body_end, num_chunks, chunk);
+
+    csr.Ap = new_host_array<IndexType>(csr.num_rows + 1);
+    std::fill(csr.Ap, csr.Ap + csr.num_rows + 1, 0);
+
+    // pass one: count the entries of every row, without parsing values
+    size_t num_entries = 0;
+    bool parse_error = false;
+    #pragma omp parallel for schedule(static,1) reduction(+:num_entries) reduction(||:parse_error)
+    for(int c = 0; c < num_chunks; c++){
+        for(const char * p = chunk[c]; p < chunk[c + 1]; p = mm_next_line(p, chunk[c + 1])){
+            if(!mm_is_entry_line(p, chunk[c + 1]))
+                continue;
+
+            IndexType row, col;
+            double val;
+            if(!mm_parse_entry(p, chunk[c + 1], false, csr.num_rows, csr.num_cols, row, col, val)){
+                parse_error = true;
+                break;
             }
-        }       
-         delete_host_array(coo.I); delete_host_array(coo.J); delete_host_array(coo.V);
-         coo.I = new_I;  coo.J = new_J; coo.V = new_V;      
-         coo.num_nonzeros = true_nonzeros;
-    } //end symmetric case
 
-    return coo;
+            #pragma omp atomic
+            csr.Ap[row]++;
+
+            if(symmetric && row != col){
+                #pragma omp atomic
+                csr.Ap[col]++;
+            }
+
+            num_entries++;
+        }
+    }
+
+    if (parse_error){
+        printf("\nUnable to parse the entries of %s\n", mm_filename);
+        exit(1);
+    }
+    if (num_entries != (size_t) num_nonzeros){
+        printf("\nExpected %lld entries but found %llu\n", num_nonzeros, (unsigned long long) num_entries);
+        exit(1);
+    }
+
+    //cumsum the nnz per row to get Ap[]
+    csr.num_nonzeros = parallel_exclusive_scan(csr.Ap, csr.num_rows);
+    csr.Ap[csr.num_rows] = csr.num_nonzeros;
+
+    csr.Aj = new_host_array<IndexType>(csr.num_nonzeros);
+    csr.Ax = read_values ? new_host_array<ValueType>(csr.num_nonzeros) : NULL;
+
+    // pass two: scatter every entry, using Ap[row] as the write cursor of row
+    #pragma omp parallel for schedule(static,1)
+    for(int c = 0; c < num_chunks; c++){
+        for(const char * p = chunk[c]; p < chunk[c + 1]; p = mm_next_line(p, chunk[c + 1])){
+            if(!mm_is_entry_line(p, chunk[c + 1]))
+                continue;
+
+            IndexType row, col, dest;
+            double val = 1.0;  //use value 1.0 for all pattern entries
+            mm_parse_entry(p, chunk[c + 1], read_values && !pattern, csr.num_rows, csr.num_cols, row, col, val);
+
+            #pragma omp atomic capture
+            dest = csr.Ap[row]++;
+            csr.Aj[dest] = col;
+            if(read_values)
+                csr.Ax[dest] = (ValueType) val;
+
+            if(symmetric && row != col){
+                #pragma omp atomic capture
+                dest = csr.Ap[col]++;
+                csr.Aj[dest] = row;
+                if(read_values)
+                    csr.Ax[dest] = (ValueType) val;
+            }
+        }
+    }
+
+    // every cursor now points at the start of the next row: shift back
+    for(IndexType i = 0, last = 0; i <= csr.num_rows; i++){
+        IndexType temp = csr.Ap[i];
+        csr.Ap[i]  = last;
+        last   = temp;
+    }
+
+    if(read_values)
+        sort_csr_columns(csr);
+    else
+        sort_csr_columns(csr.num_rows, csr.Ap, csr.Aj);
+
+    const double seconds = t.seconds_elapsed();
+    const double megabytes = (body_end - body) / 1e6;
+
+    delete_host_array(chunk);
+    unmap_file(file);
+
+    printf(" done (%.1f MB/s)\n", (seconds == 0) ? 0.0 : megabytes / seconds);
 }
 
 template <class IndexType, class ValueType>
-csr_matrix<IndexType,ValueType> read_csr_matrix(const char * mm_filename, bool compact = false)
+csr_matrix<IndexType,ValueType> read_csr_matrix_streaming(const char * mm_filename)
 {
-    coo_matrix<IndexType,ValueType> coo = read_coo_matrix<IndexType,ValueType>(mm_filename); 
+    csr_matrix<IndexType,ValueType> csr;
+    read_csr_streaming(mm_filename, csr, true);
+    return csr;
+}
 
-    csr_matrix<IndexType,ValueType> csr = coo_to_csr(coo, compact);
+////////////////////////////////////////////////////////////////////////////////
+//! Read only the nonzero pattern of a Matrix Market file
+// Uses the streaming loader without parsing or storing any values, so a
+// graph stored as a pattern (or weighted) file costs only Ap and Aj.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType>
+csr_pattern<IndexType> read_csr_pattern(const char * mm_filename)
+{
+    csr_matrix<IndexType,float> csr;
+    read_csr_streaming(mm_filename, csr, false);
 
-    delete_host_matrix(coo);
+    csr_pattern<IndexType> pattern;
+    pattern.num_rows     = csr.num_rows;
+    pattern.num_cols     = csr.num_cols;
+    pattern.num_nonzeros = csr.num_nonzeros;
+    pattern.Ap = csr.Ap;
+    pattern.Aj = csr.Aj;
+
+    return pattern;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Whether a Matrix Market file stores a pattern (no values)
+////////////////////////////////////////////////////////////////////////////////
+bool mm_is_pattern_file(const char * mm_filename)
+{
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    mm_read_header(mm_filename, matcode, num_rows, num_cols, num_nonzeros);
+    return mm_is_pattern(matcode);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read a Matrix Market file into CSR format with the loading stages fused
+// Every host thread parses its chunk of the mapped file into a private list
+// of entries, so faulting in and parsing a chunk take a single pass, and the
+// lists are converted by coo_parts_to_csr as soon as parsing ends, without
+// first gathering them into one COO matrix.  Together the lists are a full
+// COO copy of the stored entries, so peak memory is that copy plus the CSR
+// matrix plus one index per entry, as with read_csr_matrix.  The result is
+// identical to read_csr_matrix.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+csr_matrix<IndexType,ValueType> read_csr_matrix_pipelined(const char * mm_filename)
+{
+    // compressed input is inflated on its own thread by the COO reader
+    if (is_gzip_file(mm_filename))
+        return read_csr_matrix<IndexType,ValueType>(mm_filename);
+
+    csr_matrix<IndexType,ValueType> csr;
+
+    MM_typecode matcode;
+    long long num_rows, num_cols, num_nonzeros;
+    const long body_offset = mm_read_header(mm_filename, matcode, num_rows, num_cols, num_nonzeros);
+
+    // a symmetric file expands to at most twice its stored entries
+    const long long max_nonzeros = mm_is_symmetric(matcode) ? 2 * num_nonzeros : num_nonzeros;
+    if (!fits_index_type<IndexType>(num_rows, num_cols, max_nonzeros)){
+        printf("%s is too large for %d-bit indices\n", mm_filename, (int) (8 * sizeof(IndexType)));
+        exit(1);
+    }
+
+    const bool pattern   = mm_is_pattern(matcode);
+    const bool symmetric = mm_is_symmetric(matcode);
+
+    csr.num_rows = (IndexType) num_rows;
+    csr.num_cols = (IndexType) num_cols;
+
+    printf("Reading sparse matrix from file (%s):",mm_filename);
+    fflush(stdout);
+
+    host_timer t;
+
+    mapped_file file = map_file(mm_filename);
+    const char * body     = file.data + body_offset;
+    const char * body_end = file.data + file.size;
+
+    // one chunk and entry list per thread
+    const int max_threads = host_num_threads();
+    const char ** chunk = new_host_array<const char *>(max_threads + 1);
+    std::vector< std::vector<IndexType> > rows(max_threads), cols(max_threads);
+    std::vector< std::vector<ValueType> > vals(max_threads);
+
+    int num_threads = 1;
+    bool parse_error = false;
+
+    // stage one: parse
+    #pragma omp parallel num_threads(max_threads) reduction(||:parse_error)
+    {
+        #pragma omp single
+        {
+            num_threads = host_team_size();
+            mm_split_chunks(body, body_end, num_threads, chunk);
+        }
+
+        const int tid = host_thread_num();
+        const char * end = chunk[tid + 1];
+
+        // size the lists from the average line length of the file
+        const double entries_per_byte = (body_end > body) ? (double) num_nonzeros / (body_end - body) : 0;
+        const size_t estimate = (size_t) (entries_per_byte * (end - chunk[tid]) * 1.05) + 16;
+        rows[tid].reserve(estimate);
+        cols[tid].reserve(estimate);
+        vals[tid].reserve(estimate);
+
+        for(const char * p = chunk[tid]; p < end; p = mm_next_line(p, end)){
+            if(!mm_is_entry_line(p, end))
+                continue;
+
+            IndexType row, col;
+            double val = 1.0;  //use value 1.0 for all pattern entries
+            if(!mm_parse_entry(p, end, !pattern, csr.num_rows, csr.num_cols, row, col, val)){
+                parse_error = true;
+                break;
+            }
+
+            rows[tid].push_back(row);
+            cols[tid].push_back(col);
+            vals[tid].push_back((ValueType) val);
+        }
+    }
+
+    size_t num_entries = 0;
+    for(int s = 0; s < num_threads; s++)
+        num_entries += rows[s].size();
+
+    if (parse_error){
+        printf("\nUnable to parse the entries of %s\n", mm_filename);
+        exit(1);
+    }
+    if (num_entries != (size_t) num_nonzeros){
+        printf("\nExpected %lld entries but found %llu\n", num_nonzeros, (unsigned long long) num_entries);
+        exit(1);
+    }
+
+    // stage two: scatter the lists into CSR
+    std::vector<const IndexType *> I(num_threads), J(num_threads);
+    std::vector<const ValueType *> V(num_threads);
+    std::vector<size_t> size(num_threads);
+    for(int s = 0; s < num_threads; s++){
+        I[s] = rows[s].data();
+        J[s] = cols[s].data();
+        V[s] = vals[s].data();
+        size[s] = rows[s].size();
+    }
+
+    csr = coo_parts_to_csr(num_threads, &I[0], &J[0], &V[0], &size[0], csr.num_rows, csr.num_cols, symmetric);
+
+    const double seconds = t.seconds_elapsed();
+    const double megabytes = (body_end - body) / 1e6;
+
+    delete_host_array(chunk);
+    unmap_file(file);
+
+    printf(" done (%.1f MB/s)\n", (seconds == 0) ? 0.0 : megabytes / seconds);
 
     return csr;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Parallel Matrix Market writer
+// Output is byte-identical to mm_write_mtx_crd() given 1-based indices.
+// Entries are formatted in blocks, one block per thread at a time, and the
+// blocks are written in order: a thread formats its next block while the
+// previous one is still being written.
+////////////////////////////////////////////////////////////////////////////////
+
+// entries formatted per block, and an upper bound on the length of one line
+#define MM_WRITE_BLOCK_ENTRIES (1 << 16)
+#define MM_WRITE_MAX_LINE 96
+
+// same text as printf("%llu", value)
+char * mm_format_index(char * p, unsigned long long value)
+{
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (n > 0)
+        *p++ = digits[--n];
+    return p;
+}
+
+// same text as printf("%20.16g", value)
+char * mm_format_real(char * p, const double value)
+{
+    // integral values below 10^15 print as plain integers: format them here
+    if (std::fabs(value) < 1e15 && value == (double) (long long) value && !(value == 0 && std::signbit(value))){
+        char digits[24];
+        char * end = mm_format_index(digits, (unsigned long long) std::fabs(value));
+        const int length = (int) (end - digits) + (value < 0 ? 1 : 0);
+
+        for (int i = length; i < 20; i++)
+            *p++ = ' ';
+        if (value < 0)
+            *p++ = '-';
+        memcpy(p, digits, end - digits);
+        return p + (end - digits);
+    }
+
+    return p + sprintf(p, "%20.16g", value);
+}
+
+template <class IndexType, class ValueType>
+char * mm_format_entry(char * p, const IndexType row, const IndexType col, const ValueType * V, const IndexType n)
+{
+    p = mm_format_index(p, (unsigned long long) row + 1);
+    *p++ = ' ';
+    p = mm_format_index(p, (unsigned long long) col + 1);
+    if (V != NULL){
+        *p++ = ' ';
+        p = mm_format_real(p, (double) V[n]);
+    }
+    *p++ = '\n';
+    return p;
+}
+
+// write the banner and size line of a general real or pattern matrix
+FILE * mm_write_header(const char * mm_filename, const bool pattern,
+                       const unsigned long long num_rows, const unsigned long long num_cols, const unsigned long long num_nonzeros)
+{
+    FILE * fid = (strcmp(mm_filename, "stdout") == 0) ? stdout : fopen(mm_filename, "w");
+    if (fid == NULL){
+        printf("Unable to open file %s for writing\n", mm_filename);
+        exit(1);
+    }
+
+    MM_typecode matcode;
+    mm_initialize_typecode(&matcode);
+    mm_set_matrix(&matcode);
+    mm_set_coordinate(&matcode);
+    mm_set_general(&matcode);
+    if (pattern)
+        mm_set_pattern(&matcode);
+    else
+        mm_set_real(&matcode);
+
+    char * typecode = mm_typecode_to_str(matcode);
+    fprintf(fid, "%s ", MatrixMarketBanner);
+    fprintf(fid, "%s\n", typecode);
+    free(typecode);
+
+    char line[MM_WRITE_MAX_LINE];
+    char * p = mm_format_index(line, num_rows);
+    *p++ = ' ';
+    p = mm_format_index(p, num_cols);
+    *p++ = ' ';
+    p = mm_format_index(p, num_nonzeros);
+    *p++ = '\n';
+    fwrite(line, 1, p - line, fid);
+
+    return fid;
+}
+
+void mm_write_close(FILE * fid, const char * mm_filename, const bool write_error)
+{
+    if (write_error || ferror(fid) || (fid != stdout && fclose(fid) != 0)){
+        printf("Error writing file %s\n", mm_filename);
+        exit(1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write a COO matrix to a Matrix Market file
+// With 'pattern' set only the structure is written.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void write_coo_matrix(const char * mm_filename, const coo_matrix<IndexType,ValueType>& coo, const bool pattern = false)
+{
+    FILE * fid = mm_write_header(mm_filename, pattern, coo.num_rows, coo.num_cols, coo.num_nonzeros);
+    const ValueType * V = pattern ? NULL : coo.V;
+
+    const long long num_blocks = ((long long) coo.num_nonzeros + MM_WRITE_BLOCK_ENTRIES - 1) / MM_WRITE_BLOCK_ENTRIES;
+    bool write_error = false;
+
+    #pragma omp parallel
+    {
+        char * buffer = new_host_array<char>((size_t) MM_WRITE_BLOCK_ENTRIES * MM_WRITE_MAX_LINE);
+
+        #pragma omp for ordered schedule(static,1)
+        for(long long b = 0; b < num_blocks; b++){
+            const IndexType begin = (IndexType) (b * MM_WRITE_BLOCK_ENTRIES);
+            const IndexType end   = (IndexType) std::min<long long>((b + 1) * MM_WRITE_BLOCK_ENTRIES, coo.num_nonzeros);
+
+            char * p = buffer;
+            for(IndexType n = begin; n < end; n++)
+                p = mm_format_entry(p, coo.I[n], coo.J[n], V, n);
+
+            #pragma omp ordered
+            {
+                if (fwrite(buffer, 1, p - buffer, fid) != (size_t) (p - buffer))
+                    write_error = true;
+            }
+        }
+
+        delete_host_array(buffer);
+    }
+
+    mm_write_close(fid, mm_filename, write_error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write a CSR matrix to a Matrix Market file
+// Blocks hold whole rows of about MM_WRITE_BLOCK_ENTRIES entries each.
+// With 'pattern' set only the structure is written.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void write_csr_matrix(const char * mm_filename, const csr_matrix<IndexType,ValueType>& csr, const bool pattern = false)
+{
+    FILE * fid = mm_write_header(mm_filename, pattern, csr.num_rows, csr.num_cols, csr.num_nonzeros);
+    const ValueType * V = pattern ? NULL : csr.Ax;
+
+    // block b starts at the first row with an entry at or beyond b * MM_WRITE_BLOCK_ENTRIES
+    const long long num_blocks = ((long long) csr.num_nonzeros + MM_WRITE_BLOCK_ENTRIES - 1) / MM_WRITE_BLOCK_ENTRIES;
+    IndexType * block_row = new_host_array<IndexType>(num_blocks + 1);
+    for(long long b = 0; b < num_blocks; b++)
+        block_row[b] = (IndexType) (std::lower_bound(csr.Ap, csr.Ap + csr.num_rows, (IndexType) (b * MM_WRITE_BLOCK_ENTRIES)) - csr.Ap);
+    block_row[num_blocks] = csr.num_rows;
+
+    bool write_error = false;
+
+    #pragma omp parallel
+    {
+        size_t capacity = 0;
+        char * buffer = NULL;
+
+        #pragma omp for ordered schedule(static,1)
+        for(long long b = 0; b < num_blocks; b++){
+            const IndexType row_begin = block_row[b];
+            const IndexType row_end   = block_row[b + 1];
+
+            // a very long row can make a block larger than usual
+            const size_t needed = (size_t) (csr.Ap[row_end] - csr.Ap[row_begin]) * MM_WRITE_MAX_LINE;
+            if (needed > capacity){
+                delete_host_array(buffer);
+                capacity = std::max<size_t>(needed, (size_t) MM_WRITE_BLOCK_ENTRIES * MM_WRITE_MAX_LINE);
+                buffer = new_host_array<char>(capacity);
+            }
+
+            char * p = buffer;
+            for(IndexType i = row_begin; i < row_end; i++)
+                for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++)
+                    p = mm_format_entry(p, i, csr.Aj[jj], V, jj);
+
+            #pragma omp ordered
+            {
+                if (fwrite(buffer, 1, p - buffer, fid) != (size_t) (p - buffer))
+                    write_error = true;
+            }
+        }
+
+        delete_host_array(buffer);
+    }
+
+    delete_host_array(block_row);
+
+    mm_write_close(fid, mm_filename, write_error);
+}
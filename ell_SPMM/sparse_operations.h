@@ -20,86 +20,266 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <utility>
+#include <vector>
+#include <string.h>
 #include "sparse_formats.h"
 #include "mem.h"
+#include "parallel.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Sum together the duplicate nonzeros in a CSR format
 //! CSR format will be modified *in place*
+// Rows are merged in parallel, each by sorting its own entries by column
+// (no scratch arrays of size num_cols): duplicates are summed in their
+// original order and zero sums dropped, into the front of the row.  The
+// merged row lengths are then scanned into the new Ap, and the rows are
+// copied in parallel through a buffer of the merged size into place.
+// Columns come out in order of first appearance, or sorted with 'sorted'
+// set.
 //! @param num_rows       number of rows
 //! @param num_cols       number of columns
 //! @param Ap             CSR pointer array
 //! @param Ai             CSR index array
 //! @param Ax             CSR data array
+//! @param sorted         sort the columns within each row
 ////////////////////////////////////////////////////////////////////////////////
 template <class IndexType, class ValueType>
 void sum_csr_duplicates(const IndexType num_rows,
                         const IndexType num_cols, 
                               IndexType * Ap, 
                               IndexType * Aj, 
-                              ValueType * Ax)
+                              ValueType * Ax,
+                        const bool sorted = false)
 {
-    IndexType * next = new_host_array<IndexType>(num_cols);
-    ValueType * sums = new_host_array<ValueType>(num_cols);
+    // merged length of every row, scanned into its new offset
+    IndexType * row_ptr = new_host_array<IndexType>(num_rows + 1);
 
-    for(IndexType i = 0; i < num_cols; i++){
-        next[i] = (IndexType) -1;
-        sums[i] = (ValueType)   0;
-    }
+    #pragma omp parallel
+    {
+        std::vector< std::pair<IndexType,IndexType> > entries; //(column, position) of the row's entries
+        std::vector< std::pair<IndexType,IndexType> > order;   //(first position, merged entry)
+        std::vector<IndexType> cols;
+        std::vector<ValueType> sums;
+
+        #pragma omp for schedule(dynamic,256)
+        for(IndexType i = 0; i < num_rows; i++){
+            const IndexType row_start = Ap[i];
+            const IndexType row_end   = Ap[i+1];
+
+            entries.clear();
+            for(IndexType jj = row_start; jj < row_end; jj++)
+                entries.push_back(std::make_pair(Aj[jj], jj));
+            std::sort(entries.begin(), entries.end());
+
+            order.clear();
+            cols.clear();
+            sums.clear();
+            for(size_t n = 0; n < entries.size(); ){
+                const IndexType col   = entries[n].first;
+                const IndexType first = entries[n].second;
+                ValueType sum = 0;
+                for(; n < entries.size() && entries[n].first == col; n++)
+                    sum += Ax[entries[n].second];
+
+                if(sum != 0){
+                    order.push_back(std::make_pair(first, (IndexType) cols.size()));
+                    cols.push_back(col);
+                    sums.push_back(sum);
+                }
+            }
+
+            if(!sorted)
+                std::sort(order.begin(), order.end());
 
-    IndexType NNZ = 0;
+            for(size_t n = 0; n < order.size(); n++){
+                const IndexType k = sorted ? (IndexType) n : order[n].second;
+                Aj[row_start + n] = cols[k];
+                Ax[row_start + n] = sums[k];
+            }
+
+            row_ptr[i] = (IndexType) order.size();
+        }
+    }
 
-    IndexType row_start = 0;
-    IndexType row_end   = 0;
+    const IndexType num_nonzeros = parallel_exclusive_scan(row_ptr, num_rows);
+    row_ptr[num_rows] = num_nonzeros;
 
+    IndexType * new_Aj = new_host_array<IndexType>(num_nonzeros);
+    ValueType * new_Ax = new_host_array<ValueType>(num_nonzeros);
 
+    #pragma omp parallel for schedule(dynamic,256)
     for(IndexType i = 0; i < num_rows; i++){
-        IndexType head = (IndexType)-2;
+        const IndexType row_nnz = row_ptr[i+1] - row_ptr[i];
+        std::copy(Aj + Ap[i], Aj + Ap[i] + row_nnz, new_Aj + row_ptr[i]);
+        std::copy(Ax + Ap[i], Ax + Ap[i] + row_nnz, new_Ax + row_ptr[i]);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType n = 0; n < num_nonzeros; n++){
+        Aj[n] = new_Aj[n];
+        Ax[n] = new_Ax[n];
+    }
 
-        row_start = row_end; //Ap[i] may have been changed
-        row_end   = Ap[i+1]; //Ap[i+1] is safe
+    #pragma omp parallel for schedule(static)
+    for(IndexType i = 0; i <= num_rows; i++)
+        Ap[i] = row_ptr[i];
 
-        for(IndexType jj = row_start; jj < row_end; jj++){
-            IndexType j = Aj[jj];
+    delete_host_array(new_Aj);
+    delete_host_array(new_Ax);
+    delete_host_array(row_ptr);
+}
+template <class IndexType, class ValueType>
+void sum_csr_duplicates(csr_matrix<IndexType,ValueType>& A, const bool sorted = false){
+    sum_csr_duplicates(A.num_rows, A.num_cols, A.Ap, A.Aj, A.Ax, sorted);
+    A.num_nonzeros = A.Ap[A.num_rows];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! Expand a symmetric COO matrix stored as one triangle to both triangles
+//! COO format will be modified *in place*
+// Every off-diagonal entry (i,j) is followed by its mirror (j,i).  Threads
+// count their off-diagonals first, so each writes its share of the expanded
+// arrays at a known offset.
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void expand_symmetric_coo(coo_matrix<IndexType,ValueType>& coo)
+{
+    const int max_threads = host_num_threads();
+    IndexType * offset = new_host_array<IndexType>(max_threads + 1);
+
+    IndexType * new_I = NULL;
+    IndexType * new_J = NULL;
+    ValueType * new_V = NULL;
+
+    #pragma omp parallel num_threads(max_threads)
+    {
+        const int num_threads = host_team_size();
+        const int t = host_thread_num();
+        const IndexType begin = (IndexType) (((size_t) coo.num_nonzeros *  t     ) / num_threads);
+        const IndexType end   = (IndexType) (((size_t) coo.num_nonzeros * (t + 1)) / num_threads);
+
+        IndexType count = 0;
+        for(IndexType n = begin; n < end; n++)
+            count += (coo.I[n] != coo.J[n]) ? 2 : 1;
+        offset[t + 1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            offset[0] = 0;
+            for(int s = 0; s < num_threads; s++)
+                offset[s + 1] += offset[s];
+
+            new_I = new_host_array<IndexType>(offset[num_threads]);
+            new_J = new_host_array<IndexType>(offset[num_threads]);
+            new_V = new_host_array<ValueType>(offset[num_threads]);
+        }
 
-            sums[j] += Ax[jj];
-            if(next[j] == (IndexType)-1){
-                next[j] = head;                        
-                head    = j;
+        IndexType ptr = offset[t];
+        for(IndexType n = begin; n < end; n++){
+            new_I[ptr] = coo.I[n];  new_J[ptr] = coo.J[n];  new_V[ptr] = coo.V[n];
+            ptr++;
+            if(coo.I[n] != coo.J[n]){
+                new_I[ptr] = coo.J[n];  new_J[ptr] = coo.I[n];  new_V[ptr] = coo.V[n];
+                ptr++;
             }
         }
 
+        #pragma omp barrier
+        #pragma omp single
+        coo.num_nonzeros = offset[num_threads];
+    }
+
+    delete_host_array(coo.I); delete_host_array(coo.J); delete_host_array(coo.V);
+    coo.I = new_I;  coo.J = new_J; coo.V = new_V;
 
-        while(head != (IndexType)-2){
-            IndexType curr = head; //current column
-            head   = next[curr];
+    delete_host_array(offset);
+}
 
-            if(sums[curr] != 0){
-                Aj[NNZ] = curr;
-                Ax[NNZ] = sums[curr];
-                NNZ++;
+////////////////////////////////////////////////////////////////////////////////
+//! Sort the column indices (and values) within every row of a CSR matrix
+//! CSR format will be modified *in place*
+//! @param num_rows       number of rows
+//! @param Ap             CSR pointer array
+//! @param Aj             CSR index array
+//! @param Ax             CSR data array
+////////////////////////////////////////////////////////////////////////////////
+template <class IndexType, class ValueType>
+void sort_csr_columns(const IndexType num_rows,
+                      const IndexType * Ap,
+                            IndexType * Aj,
+                            ValueType * Ax)
+{
+    #pragma omp parallel for schedule(dynamic,256)
+    for(IndexType i = 0; i < num_rows; i++){
+        const IndexType row_start = Ap[i];
+        const IndexType row_end   = Ap[i+1];
+
+        if(row_end - row_start <= 32){
+            // insertion sort for the common short row
+            for(IndexType jj = row_start + 1; jj < row_end; jj++){
+                const IndexType j = Aj[jj];
+                const ValueType x = Ax[jj];
+                IndexType kk = jj;
+                while(kk > row_start && Aj[kk-1] > j){
+                    Aj[kk] = Aj[kk-1];
+                    Ax[kk] = Ax[kk-1];
+                    kk--;
+                }
+                Aj[kk] = j;
+                Ax[kk] = x;
+            }
+        } else {
+            // sort (column, position) keys, then permute the values
+            const IndexType N = row_end - row_start;
+            std::pair<IndexType,IndexType> * keys = new std::pair<IndexType,IndexType>[N];
+            ValueType * values = new_host_array<ValueType>(N);
+
+            for(IndexType n = 0; n < N; n++){
+                keys[n] = std::make_pair(Aj[row_start + n], n);
+                values[n] = Ax[row_start + n];
+            }
+            std::sort(keys, keys + N);
+            for(IndexType n = 0; n < N; n++){
+                Aj[row_start + n] = keys[n].first;
+                Ax[row_start + n] = values[keys[n].second];
             }
 
-            next[curr] = (IndexType)-1;
-            sums[curr] =  0;
+            delete [] keys;
+            delete_host_array(values);
         }
-        Ap[i+1] = NNZ;
     }
-
-    delete_host_array(next);
-    delete_host_array(sums);
 }
 template <class IndexType, class ValueType>
-void sum_csr_duplicates(csr_matrix<IndexType,ValueType>& A){
-    sum_csr_duplicates(A.num_rows, A.num_cols, A.Ap, A.Aj, A.Ax);
-    A.num_nonzeros = A.Ap[A.num_rows];
+void sort_csr_columns(csr_matrix<IndexType,ValueType>& A){
+    sort_csr_columns(A.num_rows, A.Ap, A.Aj, A.Ax);
+}
+
+// pattern-only version: there are no values to carry along
+template <class IndexType>
+void sort_csr_columns(const IndexType num_rows,
+                      const IndexType * Ap,
+                            IndexType * Aj)
+{
+    #pragma omp parallel for schedule(dynamic,256)
+    for(IndexType i = 0; i < num_rows; i++)
+        std::sort(Aj + Ap[i], Aj + Ap[i+1]);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Transpose a matrix in CSR format
 //! Storage for B is assumed to have been allocated
+// As in the streaming loader, all host threads count the entries of every
+// column atomically, then claim a slot for every entry with an atomic
+// cursor per column, and finally scatter the entries without atomics (a
+// locked update would stall on every scattered store).  Each row of A is
+// claimed by one thread in order, so after a stable sort of every row of B
+// by column, duplicates keep the order of A.  Scratch is one index per
+// nonzero, whatever the number of threads.
 //! @param Ap         CSR pointer array
 //! @param Aj         CSR column index array
 //! @param Ax         CSR data array
@@ -119,39 +299,52 @@ void csr_transpose(const IndexType * Ap,
                          IndexType * Bj, 
                          ValueType * Bx)
 {	
-    //TODO use temp-free method 
-	IndexType * temp = new_host_array<IndexType>(num_cols);
+    const IndexType num_nonzeros = Ap[num_rows];
+
+    #pragma omp parallel for schedule(static)
+    for(IndexType j = 0; j <= num_cols; j++)
+        Bp[j] = 0;
 
-    for(IndexType i = 0; i < num_cols; i++){
-        temp[i] = 0;
+    //count number of entries in each column
+    #pragma omp parallel for schedule(static)
+    for(IndexType jj = 0; jj < num_nonzeros; jj++){
+        #pragma omp atomic
+        Bp[Aj[jj]]++;
     }
 
-	IndexType num_nonzeros = Ap[num_rows];
+    //cumsum number column entries to form Bp
+    parallel_exclusive_scan(Bp, num_cols);
+    Bp[num_cols] = num_nonzeros;
 
-	for(IndexType i = 0; i < num_nonzeros; i++) //count number of entries in each column
-		temp[Aj[i]]++;
+    // claim a slot for every entry, using Bp[col] as the write cursor of column col
+    IndexType * dest = new_host_array<IndexType>(num_nonzeros);
 
-	Bp[0] = 0;
-	for(IndexType i = 0; i < num_cols; i++){		
-		Bp[i+1] = Bp[i] + temp[i];    //cumsum number column entries to form Bp
-		temp[i] = 0;                  //count number of entries in each column
-	}
-	
-	for(IndexType i = 0; i < num_rows; i++){
-		IndexType row_start = Ap[i];
-		IndexType row_end   = Ap[i+1];
-		for(IndexType jj = row_start; jj < row_end; jj++){
-			IndexType col    = Aj[jj];
-			IndexType offset = temp[col] + Bp[col];
+    #pragma omp parallel for schedule(dynamic,256)
+    for(IndexType i = 0; i < num_rows; i++){
+        for(IndexType jj = Ap[i]; jj < Ap[i+1]; jj++){
+            IndexType offset;
+            #pragma omp atomic capture
+            offset = Bp[Aj[jj]]++;
+            dest[jj] = offset;
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic,256)
+    for(IndexType i = 0; i < num_rows; i++){
+        for(IndexType jj = Ap[i]; jj < Ap[i+1]; jj++){
+            Bj[dest[jj]] = i;
+            Bx[dest[jj]] = Ax[jj];
+        }
+    }
 
-			Bj[offset] = i;
-			Bx[offset] = Ax[jj];
+    delete_host_array(dest);
 
-			temp[col]++;
-		}
-	}		
+    // every cursor now points at the start of the next column: shift back
+    for(IndexType j = num_cols; j > 0; j--)
+        Bp[j] = Bp[j-1];
+    Bp[0] = 0;
 
-    delete_host_array(temp);
+    sort_csr_columns(num_cols, Bp, Bj, Bx);
 }
 
 template <typename IndexType, typename ValueType>
@@ -0,0 +1,245 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//! CPU SpMM kernels for the CSB format
+// Task parallel, after Buluc et al.: every block row (block column for A^T)
+// is a task, long block rows are split into chunks that accumulate into
+// temporaries, and a dense block is split recursively into its quadrants.
+// The same code computes A*X and A^T*X; 'Transpose' only swaps the roles of
+// the row and column offsets.  Vectors are stored one after another, as in
+// the GPU kernels.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "sparse_formats.h"
+#include "parallel.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//! y += A*x for the entries [begin,end) of one block
+// 'x' and 'y' point at the first input and output index covered by the
+// block; ldx and ldy are the distances between consecutive vectors.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool Transpose>
+void __csb_block_spmm(const csb_matrix<IndexType,ValueType>& csb,
+                      const IndexType begin,
+                      const IndexType end,
+                      const ValueType * x, const IndexType ldx,
+                            ValueType * y, const IndexType ldy)
+{
+    const unsigned short * out = Transpose ? csb.Ac : csb.Ar;
+    const unsigned short * in  = Transpose ? csb.Ar : csb.Ac;
+
+    for(IndexType n = begin; n < end; n++){
+        const ValueType A_ij = csb.Ax[n];
+        const IndexType i = out[n];
+        const IndexType j = in[n];
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            y[i + k * ldy] += A_ij * x[j + k * ldx];
+    }
+}
+
+// first entry in [begin,end) of an aligned sub-block that lies in quadrant
+// 'q' or later, where 'half' is half the sub-block size
+template <typename IndexType, typename ValueType>
+IndexType __csb_quadrant_start(const csb_matrix<IndexType,ValueType>& csb,
+                               IndexType begin, IndexType end,
+                               const unsigned int half, const unsigned int q)
+{
+    while(begin < end){
+        const IndexType mid = begin + (end - begin) / 2;
+        const unsigned int quadrant = ((csb.Ar[mid] & half) ? 2 : 0) + ((csb.Ac[mid] & half) ? 1 : 0);
+        if(quadrant < q)
+            begin = mid + 1;
+        else
+            end = mid;
+    }
+    return begin;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! y += A*x for a dense block, split recursively into quadrants
+// Entries [begin,end) form an aligned dim x dim sub-block.  The diagonal
+// quadrants 00 and 11 touch disjoint parts of x and y and run in parallel,
+// then the off-diagonal quadrants 01 and 10 do.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool Transpose>
+void __csb_subblock_spmm(const csb_matrix<IndexType,ValueType>& csb,
+                         const IndexType begin,
+                         const IndexType end,
+                         const IndexType dim,
+                         const ValueType * x, const IndexType ldx,
+                               ValueType * y, const IndexType ldy)
+{
+    if(end - begin <= dim || dim == 1){
+        __csb_block_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, begin, end, x, ldx, y, ldy);
+        return;
+    }
+
+    const IndexType half = dim / 2;
+    const IndexType q01 = __csb_quadrant_start(csb, begin, end, (unsigned int) half, 1);
+    const IndexType q10 = __csb_quadrant_start(csb, q01,   end, (unsigned int) half, 2);
+    const IndexType q11 = __csb_quadrant_start(csb, q10,   end, (unsigned int) half, 3);
+
+    #pragma omp task
+    __csb_subblock_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, begin, q01, half, x, ldx, y, ldy);
+    __csb_subblock_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, q11, end, half, x, ldx, y, ldy);
+    #pragma omp taskwait
+
+    #pragma omp task
+    __csb_subblock_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, q01, q10, half, x, ldx, y, ldy);
+    __csb_subblock_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, q10, q11, half, x, ldx, y, ldy);
+    #pragma omp taskwait
+}
+
+// index of the block at position 'minor' along block row (or, transposed,
+// block column) 'major'
+template <typename IndexType, typename ValueType, bool Transpose>
+IndexType __csb_block_index(const csb_matrix<IndexType,ValueType>& csb, const IndexType major, const IndexType minor)
+{
+    return Transpose ? minor * csb.num_block_cols + major : major * csb.num_block_cols + minor;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! y += A*x for the chunks [lo,hi) of one block row
+// chunks[c] is the first block of chunk c.  The first half of the chunks
+// adds into y while the second half adds into a zeroed temporary in
+// parallel, which is then added to y.  A chunk made of one block that holds
+// more than beta entries is a dense block and is split into quadrants.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool Transpose>
+void __csb_blockrow_spmm(const csb_matrix<IndexType,ValueType>& csb,
+                         const IndexType major,
+                         const IndexType * chunks,
+                         const IndexType lo,
+                         const IndexType hi,
+                         const ValueType * x, const IndexType ldx,
+                               ValueType * y, const IndexType ldy,
+                         const IndexType height)
+{
+    const IndexType beta = csb.beta;
+
+    if(hi - lo == 1){
+        const IndexType first = chunks[lo];
+        const IndexType last  = chunks[lo + 1];
+        if(last - first == 1){
+            const IndexType b = __csb_block_index<IndexType,ValueType,Transpose>(csb, major, first);
+            __csb_subblock_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, csb.blk_ptr[b], csb.blk_ptr[b+1], beta, x + first * beta, ldx, y, ldy);
+            return;
+        }
+        for(IndexType minor = first; minor < last; minor++){
+            const IndexType b = __csb_block_index<IndexType,ValueType,Transpose>(csb, major, minor);
+            __csb_block_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, csb.blk_ptr[b], csb.blk_ptr[b+1], x + minor * beta, ldx, y, ldy);
+        }
+        return;
+    }
+
+    const IndexType mid = lo + (hi - lo) / 2;
+    ValueType * z = new_host_array<ValueType>((size_t) height * NUMVECTORS);
+    std::fill(z, z + (size_t) height * NUMVECTORS, 0);
+
+    #pragma omp task
+    __csb_blockrow_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, major, chunks, lo, mid, x, ldx, y, ldy, height);
+    __csb_blockrow_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, major, chunks, mid, hi, x, ldx, z, height, height);
+    #pragma omp taskwait
+
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        for(IndexType i = 0; i < height; i++)
+            y[i + k * ldy] += z[i + k * height];
+
+    delete_host_array(z);
+}
+
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool Transpose>
+void __spmm_csb_host(const csb_matrix<IndexType,ValueType>& csb,
+                     const ValueType * x,
+                           ValueType * y)
+{
+    const IndexType beta      = csb.beta;
+    const IndexType num_major = Transpose ? csb.num_block_cols : csb.num_block_rows;
+    const IndexType num_minor = Transpose ? csb.num_block_rows : csb.num_block_cols;
+    const IndexType ldx       = Transpose ? csb.num_rows : csb.num_cols;
+    const IndexType ldy       = Transpose ? csb.num_cols : csb.num_rows;
+
+    #pragma omp parallel
+    #pragma omp single
+    for(IndexType major = 0; major < num_major; major++){
+        #pragma omp task
+        {
+            // consecutive blocks are grouped into chunks of about beta entries
+            std::vector<IndexType> chunks(1, 0);
+            IndexType chunk_entries = 0;
+            for(IndexType minor = 0; minor < num_minor; minor++){
+                const IndexType b = __csb_block_index<IndexType,ValueType,Transpose>(csb, major, minor);
+                const IndexType block_entries = csb.blk_ptr[b+1] - csb.blk_ptr[b];
+                if(chunk_entries > 0 && chunk_entries + block_entries > beta){
+                    chunks.push_back(minor);
+                    chunk_entries = 0;
+                }
+                chunk_entries += block_entries;
+            }
+            chunks.push_back(num_minor);
+
+            const IndexType height = std::min(beta, ldy - major * beta);
+            __csb_blockrow_spmm<IndexType,ValueType,NUMVECTORS,Transpose>(csb, major, &chunks[0], 0, (IndexType) chunks.size() - 1,
+                                                                          x, ldx, y + major * beta, ldy, height);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Y += A*X on the host for NUMVECTORS vectors of a CSB matrix
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void spmm_csb_host(const csb_matrix<IndexType,ValueType>& csb,
+                   const ValueType * x,
+                         ValueType * y,
+                         IndexType NUMVECTORS)
+{
+    switch (NUMVECTORS){
+    case 2:  __spmm_csb_host<IndexType,ValueType,2,false>(csb, x, y);  break;
+    case 4:  __spmm_csb_host<IndexType,ValueType,4,false>(csb, x, y);  break;
+    case 8:  __spmm_csb_host<IndexType,ValueType,8,false>(csb, x, y);  break;
+    case 16: __spmm_csb_host<IndexType,ValueType,16,false>(csb, x, y); break;
+    case 32: __spmm_csb_host<IndexType,ValueType,32,false>(csb, x, y); break;
+    default:
+        printf("Unsupported number of vectors %d\n", (int) NUMVECTORS);
+        exit(1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Y += A^T*X on the host for NUMVECTORS vectors of a CSB matrix
+// x holds vectors of num_rows entries and y vectors of num_cols entries.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void spmm_csb_transpose_host(const csb_matrix<IndexType,ValueType>& csb,
+                             const ValueType * x,
+                                   ValueType * y,
+                                   IndexType NUMVECTORS)
+{
+    switch (NUMVECTORS){
+    case 2:  __spmm_csb_host<IndexType,ValueType,2,true>(csb, x, y);  break;
+    case 4:  __spmm_csb_host<IndexType,ValueType,4,true>(csb, x, y);  break;
+    case 8:  __spmm_csb_host<IndexType,ValueType,8,true>(csb, x, y);  break;
+    case 16: __spmm_csb_host<IndexType,ValueType,16,true>(csb, x, y); break;
+    case 32: __spmm_csb_host<IndexType,ValueType,32,true>(csb, x, y); break;
+    default:
+        printf("Unsupported number of vectors %d\n", (int) NUMVECTORS);
+        exit(1);
+    }
+}
@@ -74,7 +74,7 @@ spmm_ell_kernel4(const IndexType num_rows,
 
     if(row >= num_rows){ return; }
 
-    int temp=row;
+    IndexType temp=row;
     ValueType sum1 = y[row];
     temp += num_rows;
     ValueType sum2 = y[temp];
@@ -131,7 +131,7 @@ spmm_ell_kernel8(const IndexType num_rows,
 
     if(row >= num_rows){ return; }
 
-    int temp=row;
+    IndexType temp=row;
     ValueType sum1 = y[row];
     temp += num_rows;
     ValueType sum2 = y[temp];
@@ -214,7 +214,7 @@ spmm_ell_kernel16(const IndexType num_rows,
 
     if(row >= num_rows){ return; }
 
-    int temp=row;
+    IndexType temp=row;
     ValueType sum1 = y[row];
     temp += num_rows;
     ValueType sum2 = y[temp];
@@ -350,7 +350,7 @@ spmm_ell_kernel32(const IndexType num_rows,
 
     if(row >= num_rows){ return; }
 
-    int temp=row;
+    IndexType temp=row;
     ValueType sum1 = y[row];
     temp += num_rows;
     ValueType sum2 = y[temp];
@@ -647,3 +647,1007 @@ void spmm_ell_tex_device(const ell_matrix<IndexType,ValueType>& d_ell,
     unbind_x(d_x);
 }
 
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on an ELL matrix whose values are stored in a narrower type
+// MatrixType is the storage of Ax (e.g. float or bfloat16), ValueType that of
+// x and y, and ComputeType that of the sums.  Each value is widened to
+// ComputeType in registers, so only the matrix traffic shrinks.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename MatrixType, typename ComputeType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_ell_mixed_kernel(const IndexType num_rows, 
+                      const IndexType num_cols, 
+                      const IndexType num_cols_per_row,
+                      const IndexType stride,
+                      const IndexType * Aj,
+                      const MatrixType * Ax, 
+                      const ValueType * x, 
+                            ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ComputeType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = y[row + k * num_rows];
+
+    Aj += row;
+    Ax += row;
+
+    for(IndexType n = 0; n < num_cols_per_row; n++){
+        const ComputeType A_ij = (ComputeType) *Ax;
+
+        if (A_ij != 0){
+            const IndexType col = *Aj;
+            #pragma unroll
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                sum[k] += A_ij * (ComputeType) fetch_x<UseCache>(col + k * num_cols, x);
+        }
+
+        Aj += stride;
+        Ax += stride;
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] = (ValueType) sum[k];
+}
+
+template <typename IndexType, typename MatrixType, typename ComputeType, typename ValueType>
+void spmm_ell_mixed_device(const ell_matrix<IndexType,MatrixType>& d_ell, 
+                           const ValueType * d_x, 
+                                 ValueType * d_y,
+                                 IndexType NUMVECTORS,
+                                 IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_ell.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_ell.num_cols;
+              ValueType * y = d_y + vec*d_ell.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_ell_mixed_kernel<IndexType,MatrixType,ComputeType,ValueType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Ax, x, y);
+            break;
+        case 4:
+            spmm_ell_mixed_kernel<IndexType,MatrixType,ComputeType,ValueType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Ax, x, y);
+            break;
+        case 8:
+            spmm_ell_mixed_kernel<IndexType,MatrixType,ComputeType,ValueType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Ax, x, y);
+            break;
+        case 16:
+            spmm_ell_mixed_kernel<IndexType,MatrixType,ComputeType,ValueType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Ax, x, y);
+            break;
+        case 32:
+            spmm_ell_mixed_kernel<IndexType,MatrixType,ComputeType,ValueType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Ax, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a quantized ELL matrix
+// The integer values are multiplied with x as they are and the sums are
+// scaled once per row at the end, so dequantization costs one multiply per
+// row and vector and the values stream as 1 or 2 bytes each.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename QuantType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_quantized_ell_kernel(const IndexType num_rows, 
+                          const IndexType num_cols, 
+                          const IndexType num_cols_per_row,
+                          const IndexType stride,
+                          const IndexType * Aj,
+                          const QuantType * Aq, 
+                          const ValueType * row_scale, 
+                          const ValueType * x, 
+                                ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = 0;
+
+    Aj += row;
+    Aq += row;
+
+    for(IndexType n = 0; n < num_cols_per_row; n++){
+        const QuantType A_q = *Aq;
+
+        if (A_q != 0){
+            const IndexType col = *Aj;
+            const ValueType A_ij = (ValueType) A_q;
+            #pragma unroll
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+        }
+
+        Aj += stride;
+        Aq += stride;
+    }
+
+    const ValueType scale = row_scale[row];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] += scale * sum[k];
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void spmm_quantized_ell_device(const quantized_ell_matrix<IndexType,ValueType,QuantType>& d_ell, 
+                               const ValueType * d_x, 
+                                     ValueType * d_y,
+                                     IndexType NUMVECTORS,
+                                     IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_ell.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_ell.num_cols;
+              ValueType * y = d_y + vec*d_ell.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_quantized_ell_kernel<IndexType,ValueType,QuantType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Aq, d_ell.row_scale, x, y);
+            break;
+        case 4:
+            spmm_quantized_ell_kernel<IndexType,ValueType,QuantType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Aq, d_ell.row_scale, x, y);
+            break;
+        case 8:
+            spmm_quantized_ell_kernel<IndexType,ValueType,QuantType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Aq, d_ell.row_scale, x, y);
+            break;
+        case 16:
+            spmm_quantized_ell_kernel<IndexType,ValueType,QuantType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Aq, d_ell.row_scale, x, y);
+            break;
+        case 32:
+            spmm_quantized_ell_kernel<IndexType,ValueType,QuantType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, d_ell.Aq, d_ell.row_scale, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a quantized CSR matrix, one thread per row
+// Dequantized as in the quantized ELL kernel.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename QuantType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_quantized_csr_kernel(const IndexType num_rows, 
+                          const IndexType num_cols, 
+                          const IndexType * Ap,
+                          const IndexType * Aj,
+                          const QuantType * Aq, 
+                          const ValueType * row_scale, 
+                          const ValueType * x, 
+                                ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = 0;
+
+    const IndexType row_end = Ap[row + 1];
+
+    for(IndexType jj = Ap[row]; jj < row_end; jj++){
+        const IndexType col  = Aj[jj];
+        const ValueType A_ij = (ValueType) Aq[jj];
+
+        #pragma unroll
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+    }
+
+    const ValueType scale = row_scale[row];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] += scale * sum[k];
+}
+
+template <typename IndexType, typename ValueType, typename QuantType>
+void spmm_quantized_csr_device(const quantized_csr_matrix<IndexType,ValueType,QuantType>& d_csr, 
+                               const ValueType * d_x, 
+                                     ValueType * d_y,
+                                     IndexType NUMVECTORS,
+                                     IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_csr.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_csr.num_cols;
+              ValueType * y = d_y + vec*d_csr.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_quantized_csr_kernel<IndexType,ValueType,QuantType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_csr.num_rows, d_csr.num_cols, d_csr.Ap, d_csr.Aj, d_csr.Aq, d_csr.row_scale, x, y);
+            break;
+        case 4:
+            spmm_quantized_csr_kernel<IndexType,ValueType,QuantType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_csr.num_rows, d_csr.num_cols, d_csr.Ap, d_csr.Aj, d_csr.Aq, d_csr.row_scale, x, y);
+            break;
+        case 8:
+            spmm_quantized_csr_kernel<IndexType,ValueType,QuantType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_csr.num_rows, d_csr.num_cols, d_csr.Ap, d_csr.Aj, d_csr.Aq, d_csr.row_scale, x, y);
+            break;
+        case 16:
+            spmm_quantized_csr_kernel<IndexType,ValueType,QuantType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_csr.num_rows, d_csr.num_cols, d_csr.Ap, d_csr.Aj, d_csr.Aq, d_csr.row_scale, x, y);
+            break;
+        case 32:
+            spmm_quantized_csr_kernel<IndexType,ValueType,QuantType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_csr.num_rows, d_csr.num_cols, d_csr.Ap, d_csr.Aj, d_csr.Aq, d_csr.row_scale, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a pattern-only ELL matrix
+// Every nonzero is one, so x[col] is added without a multiply and no Ax is
+// read.  A padding index ends the row, since padding follows the used slots.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_ell_pattern_kernel(const IndexType num_rows, 
+                        const IndexType num_cols, 
+                        const IndexType num_cols_per_row,
+                        const IndexType stride,
+                        const IndexType * Aj,
+                        const ValueType * x, 
+                              ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = y[row + k * num_rows];
+
+    Aj += row;
+
+    for(IndexType n = 0; n < num_cols_per_row; n++){
+        const IndexType col = *Aj;
+
+        if (col == (IndexType) -1)
+            break;
+
+        #pragma unroll
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            sum[k] += fetch_x<UseCache>(col + k * num_cols, x);
+
+        Aj += stride;
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] = sum[k];
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_ell_pattern_device(const ell_pattern<IndexType>& d_ell, 
+                             const ValueType * d_x, 
+                                   ValueType * d_y,
+                                   IndexType NUMVECTORS,
+                                   IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_ell.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_ell.num_cols;
+              ValueType * y = d_y + vec*d_ell.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_ell_pattern_kernel<IndexType,ValueType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, x, y);
+            break;
+        case 4:
+            spmm_ell_pattern_kernel<IndexType,ValueType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, x, y);
+            break;
+        case 8:
+            spmm_ell_pattern_kernel<IndexType,ValueType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, x, y);
+            break;
+        case 16:
+            spmm_ell_pattern_kernel<IndexType,ValueType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, x, y);
+            break;
+        case 32:
+            spmm_ell_pattern_kernel<IndexType,ValueType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell.num_rows, d_ell.num_cols, d_ell.num_cols_per_row, d_ell.stride, d_ell.Aj, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on an ELL-R matrix
+// Each row stops after its own Arl[row] slots, so the padding is never read
+// and no value is tested: explicit zeros stored in the matrix are kept.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_ellr_kernel(const IndexType num_rows, 
+                 const IndexType num_cols, 
+                 const IndexType stride,
+                 const IndexType * Arl,
+                 const IndexType * Aj,
+                 const ValueType * Ax, 
+                 const ValueType * x, 
+                       ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = y[row + k * num_rows];
+
+    const IndexType row_length = Arl[row];
+
+    Aj += row;
+    Ax += row;
+
+    for(IndexType n = 0; n < row_length; n++){
+        const ValueType A_ij = *Ax;
+        const IndexType col  = *Aj;
+
+        #pragma unroll
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+
+        Aj += stride;
+        Ax += stride;
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] = sum[k];
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_ellr_device(const ellr_matrix<IndexType,ValueType>& d_ellr, 
+                      const ValueType * d_x, 
+                            ValueType * d_y,
+                            IndexType NUMVECTORS,
+                            IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_ellr.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_ellr.num_cols;
+              ValueType * y = d_y + vec*d_ellr.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_ellr_kernel<IndexType,ValueType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_ellr.num_rows, d_ellr.num_cols, d_ellr.stride, d_ellr.Arl, d_ellr.Aj, d_ellr.Ax, x, y);
+            break;
+        case 4:
+            spmm_ellr_kernel<IndexType,ValueType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_ellr.num_rows, d_ellr.num_cols, d_ellr.stride, d_ellr.Arl, d_ellr.Aj, d_ellr.Ax, x, y);
+            break;
+        case 8:
+            spmm_ellr_kernel<IndexType,ValueType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_ellr.num_rows, d_ellr.num_cols, d_ellr.stride, d_ellr.Arl, d_ellr.Aj, d_ellr.Ax, x, y);
+            break;
+        case 16:
+            spmm_ellr_kernel<IndexType,ValueType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_ellr.num_rows, d_ellr.num_cols, d_ellr.stride, d_ellr.Arl, d_ellr.Aj, d_ellr.Ax, x, y);
+            break;
+        case 32:
+            spmm_ellr_kernel<IndexType,ValueType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_ellr.num_rows, d_ellr.num_cols, d_ellr.stride, d_ellr.Arl, d_ellr.Aj, d_ellr.Ax, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on an ELL16 matrix
+// As the ELL kernels, but a row in a narrow block reads a 16-bit offset per
+// slot and adds it to the block's base column.  Blocks are one warp of rows,
+// so all threads of a warp take the same path.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_ell16_kernel(const IndexType num_rows, 
+                  const IndexType num_cols, 
+                  const IndexType num_cols_per_row,
+                  const IndexType stride,
+                  const IndexType * block_base,
+                  const IndexType * wide_pos,
+                  const unsigned short * Ajs,
+                  const IndexType * Aj,
+                  const ValueType * Ax, 
+                  const ValueType * x, 
+                        ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = y[row + k * num_rows];
+
+    const IndexType block = row / ELL16_BLOCK_ROWS;
+    const IndexType base  = block_base[block];
+
+    Ax += row;
+
+    if (base != (IndexType) -1){
+        Ajs += row;
+
+        for(IndexType n = 0; n < num_cols_per_row; n++){
+            const ValueType A_ij = *Ax;
+
+            if (A_ij != 0){
+                const IndexType col = base + *Ajs;
+                #pragma unroll
+                for(unsigned int k = 0; k < NUMVECTORS; k++)
+                    sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+            }
+
+            Ajs += stride;
+            Ax  += stride;
+        }
+    } else {
+        // columns too far apart for offsets: full indices, block by block
+        Aj += wide_pos[block] * num_cols_per_row * ELL16_BLOCK_ROWS + row % ELL16_BLOCK_ROWS;
+
+        for(IndexType n = 0; n < num_cols_per_row; n++){
+            const ValueType A_ij = *Ax;
+
+            if (A_ij != 0){
+                const IndexType col = *Aj;
+                #pragma unroll
+                for(unsigned int k = 0; k < NUMVECTORS; k++)
+                    sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+            }
+
+            Aj += ELL16_BLOCK_ROWS;
+            Ax += stride;
+        }
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] = sum[k];
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_ell16_device(const ell16_matrix<IndexType,ValueType>& d_ell16, 
+                       const ValueType * d_x, 
+                             ValueType * d_y,
+                             IndexType NUMVECTORS,
+                             IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_ell16.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_ell16.num_cols;
+              ValueType * y = d_y + vec*d_ell16.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_ell16_kernel<IndexType,ValueType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell16.num_rows, d_ell16.num_cols, d_ell16.num_cols_per_row, d_ell16.stride, d_ell16.block_base, d_ell16.wide_pos, d_ell16.Ajs, d_ell16.Aj, d_ell16.Ax, x, y);
+            break;
+        case 4:
+            spmm_ell16_kernel<IndexType,ValueType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell16.num_rows, d_ell16.num_cols, d_ell16.num_cols_per_row, d_ell16.stride, d_ell16.block_base, d_ell16.wide_pos, d_ell16.Ajs, d_ell16.Aj, d_ell16.Ax, x, y);
+            break;
+        case 8:
+            spmm_ell16_kernel<IndexType,ValueType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell16.num_rows, d_ell16.num_cols, d_ell16.num_cols_per_row, d_ell16.stride, d_ell16.block_base, d_ell16.wide_pos, d_ell16.Ajs, d_ell16.Aj, d_ell16.Ax, x, y);
+            break;
+        case 16:
+            spmm_ell16_kernel<IndexType,ValueType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell16.num_rows, d_ell16.num_cols, d_ell16.num_cols_per_row, d_ell16.stride, d_ell16.block_base, d_ell16.wide_pos, d_ell16.Ajs, d_ell16.Aj, d_ell16.Ax, x, y);
+            break;
+        case 32:
+            spmm_ell16_kernel<IndexType,ValueType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_ell16.num_rows, d_ell16.num_cols, d_ell16.num_cols_per_row, d_ell16.stride, d_ell16.block_base, d_ell16.wide_pos, d_ell16.Ajs, d_ell16.Aj, d_ell16.Ax, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a DIA matrix
+// One thread per row.  No column indices are read: the block loads the
+// diagonal offsets into shared memory a chunk at a time, and consecutive
+// rows read consecutive entries of x along each diagonal.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, unsigned int BLOCK_SIZE, bool UseCache>
+__global__ void
+spmm_dia_kernel(const IndexType num_rows, 
+                const IndexType num_cols, 
+                const IndexType num_diagonals,
+                const IndexType stride,
+                const long long * diagonal_offsets,
+                const ValueType * diagonal_data, 
+                const ValueType * x, 
+                      ValueType * y)
+{
+    __shared__ long long offsets[BLOCK_SIZE];
+
+    // no early return: every thread takes part in loading the offsets
+    const IndexType row = large_grid_thread_id();
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = 0;
+
+    for(IndexType base = 0; base < num_diagonals; base += BLOCK_SIZE){
+        __syncthreads();
+        if(base + threadIdx.x < num_diagonals)
+            offsets[threadIdx.x] = diagonal_offsets[base + threadIdx.x];
+        __syncthreads();
+
+        if(row < num_rows){
+            const IndexType chunk_length = min((IndexType) BLOCK_SIZE, num_diagonals - base);
+            const ValueType * A = diagonal_data + base * stride + row;
+
+            for(IndexType n = 0; n < chunk_length; n++){
+                const long long col = (long long) row + offsets[n];
+
+                if(col >= 0 && col < (long long) num_cols){
+                    const ValueType A_ij = *A;
+                    #pragma unroll
+                    for(unsigned int k = 0; k < NUMVECTORS; k++)
+                        sum[k] += A_ij * fetch_x<UseCache>((IndexType) col + k * num_cols, x);
+                }
+
+                A += stride;
+            }
+        }
+    }
+
+    if(row < num_rows){
+        #pragma unroll
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            y[row + k * num_rows] += sum[k];
+    }
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_dia_device(const dia_matrix<IndexType,ValueType>& d_dia, 
+                     const ValueType * d_x, 
+                           ValueType * d_y,
+                           IndexType NUMVECTORS,
+                           IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_dia.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_dia.num_cols;
+              ValueType * y = d_y + vec*d_dia.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_dia_kernel<IndexType,ValueType,2,BLOCK_SIZE,false> <<<grid, BLOCK_SIZE>>>
+            (d_dia.num_rows, d_dia.num_cols, d_dia.num_diagonals, d_dia.stride, d_dia.diagonal_offsets, d_dia.diagonal_data, x, y);
+            break;
+        case 4:
+            spmm_dia_kernel<IndexType,ValueType,4,BLOCK_SIZE,false> <<<grid, BLOCK_SIZE>>>
+            (d_dia.num_rows, d_dia.num_cols, d_dia.num_diagonals, d_dia.stride, d_dia.diagonal_offsets, d_dia.diagonal_data, x, y);
+            break;
+        case 8:
+            spmm_dia_kernel<IndexType,ValueType,8,BLOCK_SIZE,false> <<<grid, BLOCK_SIZE>>>
+            (d_dia.num_rows, d_dia.num_cols, d_dia.num_diagonals, d_dia.stride, d_dia.diagonal_offsets, d_dia.diagonal_data, x, y);
+            break;
+        case 16:
+            spmm_dia_kernel<IndexType,ValueType,16,BLOCK_SIZE,false> <<<grid, BLOCK_SIZE>>>
+            (d_dia.num_rows, d_dia.num_cols, d_dia.num_diagonals, d_dia.stride, d_dia.diagonal_offsets, d_dia.diagonal_data, x, y);
+            break;
+        case 32:
+            spmm_dia_kernel<IndexType,ValueType,32,BLOCK_SIZE,false> <<<grid, BLOCK_SIZE>>>
+            (d_dia.num_rows, d_dia.num_cols, d_dia.num_diagonals, d_dia.stride, d_dia.diagonal_offsets, d_dia.diagonal_data, x, y);
+            break;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a sliced ELL (SELL-C-sigma) matrix
+// One thread per sorted row.  The threads of a slice read consecutive slots
+// of each column of the slice, and stop at the width of their own slice
+// rather than at the longest row of the matrix.  Results are written to the
+// original row, so y is in the same order as for the other formats.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_sell_kernel(const IndexType num_rows, 
+                 const IndexType num_cols, 
+                 const IndexType slice_size,
+                 const IndexType * slice_ptr,
+                 const IndexType * row_perm,
+                 const IndexType * Aj,
+                 const ValueType * Ax, 
+                 const ValueType * x, 
+                       ValueType * y)
+{
+    const IndexType i = large_grid_thread_id();
+
+    if(i >= num_rows){ return; }
+
+    const IndexType slice = i / slice_size;
+    const IndexType row   = row_perm[i];
+    const IndexType end   = slice_ptr[slice + 1];
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = y[row + k * num_rows];
+
+    for(IndexType jj = slice_ptr[slice] + (i - slice * slice_size); jj < end; jj += slice_size){
+        const ValueType A_ij = Ax[jj];
+
+        if (A_ij != 0){
+            const IndexType col = Aj[jj];
+            #pragma unroll
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+        }
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        y[row + k * num_rows] = sum[k];
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_sell_device(const sell_matrix<IndexType,ValueType>& d_sell, 
+                      const ValueType * d_x, 
+                            ValueType * d_y,
+                            IndexType NUMVECTORS,
+                            IndexType VECBLOCK)
+{
+    const unsigned int BLOCK_SIZE = 256;
+    const dim3 grid = make_large_grid(d_sell.num_rows, BLOCK_SIZE);
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_sell.num_cols;
+              ValueType * y = d_y + vec*d_sell.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:
+            spmm_sell_kernel<IndexType,ValueType,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_sell.num_rows, d_sell.num_cols, d_sell.slice_size, d_sell.slice_ptr, d_sell.row_perm, d_sell.Aj, d_sell.Ax, x, y);
+            break;
+        case 4:
+            spmm_sell_kernel<IndexType,ValueType,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_sell.num_rows, d_sell.num_cols, d_sell.slice_size, d_sell.slice_ptr, d_sell.row_perm, d_sell.Aj, d_sell.Ax, x, y);
+            break;
+        case 8:
+            spmm_sell_kernel<IndexType,ValueType,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_sell.num_rows, d_sell.num_cols, d_sell.slice_size, d_sell.slice_ptr, d_sell.row_perm, d_sell.Aj, d_sell.Ax, x, y);
+            break;
+        case 16:
+            spmm_sell_kernel<IndexType,ValueType,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_sell.num_rows, d_sell.num_cols, d_sell.slice_size, d_sell.slice_ptr, d_sell.row_perm, d_sell.Aj, d_sell.Ax, x, y);
+            break;
+        case 32:
+            spmm_sell_kernel<IndexType,ValueType,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_sell.num_rows, d_sell.num_cols, d_sell.slice_size, d_sell.slice_ptr, d_sell.row_perm, d_sell.Aj, d_sell.Ax, x, y);
+            break;
+        }
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a HYB (ELL + COO) matrix
+// The ELL part and the COO tail run concurrently on two streams.  Both add
+// their contributions to y atomically: the ELL kernel once per row and
+// vector, after summing the row's slots from zero, and the COO kernel once
+// per entry and vector.  Neither kernel reads y, so no update can be lost
+// however the two interleave.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_hyb_ell_kernel(const IndexType num_rows, 
+                    const IndexType num_cols, 
+                    const IndexType num_cols_per_row,
+                    const IndexType stride,
+                    const IndexType * Aj,
+                    const ValueType * Ax, 
+                    const ValueType * x, 
+                          ValueType * y)
+{
+    const IndexType row = large_grid_thread_id();
+
+    if(row >= num_rows){ return; }
+
+    ValueType sum[NUMVECTORS];
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        sum[k] = 0;
+
+    Aj += row;
+    Ax += row;
+
+    for(IndexType n = 0; n < num_cols_per_row; n++){
+        const ValueType A_ij = *Ax;
+
+        if (A_ij != 0){
+            const IndexType col = *Aj;
+            #pragma unroll
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                sum[k] += A_ij * fetch_x<UseCache>(col + k * num_cols, x);
+        }
+
+        Aj += stride;
+        Ax += stride;
+    }
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        atomic_add(y + row + k * num_rows, sum[k]);
+}
+
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_coo_atomic_kernel(const IndexType num_nonzeros, 
+                       const IndexType num_rows, 
+                       const IndexType num_cols, 
+                       const IndexType * I,
+                       const IndexType * J,
+                       const ValueType * V, 
+                       const ValueType * x, 
+                             ValueType * y)
+{
+    const IndexType n = large_grid_thread_id();
+
+    if(n >= num_nonzeros){ return; }
+
+    const IndexType row  = I[n];
+    const IndexType col  = J[n];
+    const ValueType A_ij = V[n];
+
+    #pragma unroll
+    for(unsigned int k = 0; k < NUMVECTORS; k++)
+        atomic_add(y + row + k * num_rows, A_ij * fetch_x<UseCache>(col + k * num_cols, x));
+}
+
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS>
+void __spmm_hyb_device(const hyb_matrix<IndexType,ValueType>& d_hyb, 
+                       const ValueType * x, 
+                             ValueType * y,
+                       cudaStream_t ell_stream,
+                       cudaStream_t coo_stream)
+{
+    const unsigned int BLOCK_SIZE = 256;
+
+    const ell_matrix<IndexType,ValueType>& ell = d_hyb.ell;
+    const coo_matrix<IndexType,ValueType>& coo = d_hyb.coo;
+
+    if (ell.num_cols_per_row > 0){
+        const dim3 grid = make_large_grid(ell.num_rows, BLOCK_SIZE);
+        spmm_hyb_ell_kernel<IndexType,ValueType,NUMVECTORS,false> <<<grid, BLOCK_SIZE, 0, ell_stream>>>
+        (ell.num_rows, ell.num_cols, ell.num_cols_per_row, ell.stride, ell.Aj, ell.Ax, x, y);
+    }
+
+    if (coo.num_nonzeros > 0){
+        const dim3 grid = make_large_grid(coo.num_nonzeros, BLOCK_SIZE);
+        spmm_coo_atomic_kernel<IndexType,ValueType,NUMVECTORS,false> <<<grid, BLOCK_SIZE, 0, coo_stream>>>
+        (coo.num_nonzeros, coo.num_rows, coo.num_cols, coo.I, coo.J, coo.V, x, y);
+    }
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_hyb_device(const hyb_matrix<IndexType,ValueType>& d_hyb, 
+                     const ValueType * d_x, 
+                           ValueType * d_y,
+                           IndexType NUMVECTORS,
+                           IndexType VECBLOCK)
+{
+    // created once; these streams synchronize with the default stream, so
+    // the result is complete before any later copy of y
+    static cudaStream_t ell_stream = 0, coo_stream = 0;
+    if (ell_stream == 0){
+        cudaStreamCreate(&ell_stream);
+        cudaStreamCreate(&coo_stream);
+    }
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_hyb.num_cols;
+              ValueType * y = d_y + vec*d_hyb.num_rows;
+
+        switch (NUMVECTORS){
+        case 2:  __spmm_hyb_device<IndexType,ValueType,2> (d_hyb, x, y, ell_stream, coo_stream); break;
+        case 4:  __spmm_hyb_device<IndexType,ValueType,4> (d_hyb, x, y, ell_stream, coo_stream); break;
+        case 8:  __spmm_hyb_device<IndexType,ValueType,8> (d_hyb, x, y, ell_stream, coo_stream); break;
+        case 16: __spmm_hyb_device<IndexType,ValueType,16>(d_hyb, x, y, ell_stream, coo_stream); break;
+        case 32: __spmm_hyb_device<IndexType,ValueType,32>(d_hyb, x, y, ell_stream, coo_stream); break;
+        }
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//! SpMM on a block ELL matrix
+// One thread per block row.  The B x B block and the B x NUMVECTORS partial
+// sums are kept in registers: each block column index is read once per
+// block, and each value of x once per block and vector, for B rows.
+// A padding block column ends the block row.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, unsigned int B, unsigned int NUMVECTORS, bool UseCache>
+__global__ void
+spmm_bell_kernel(const IndexType num_rows, 
+                 const IndexType num_cols, 
+                 const IndexType num_block_rows,
+                 const IndexType num_blocks_per_row,
+                 const IndexType stride,
+                 const IndexType * Aj,
+                 const ValueType * Ax, 
+                 const ValueType * x, 
+                       ValueType * y)
+{
+    const IndexType block_row = large_grid_thread_id();
+
+    if(block_row >= num_block_rows){ return; }
+
+    ValueType sum[B][NUMVECTORS];
+    #pragma unroll
+    for(unsigned int r = 0; r < B; r++)
+        #pragma unroll
+        for(unsigned int k = 0; k < NUMVECTORS; k++)
+            sum[r][k] = 0;
+
+    Aj += block_row;
+    Ax += block_row;
+
+    for(IndexType n = 0; n < num_blocks_per_row; n++){
+        const IndexType block_col = *Aj;
+
+        if (block_col == (IndexType) -1)
+            break;
+
+        ValueType A[B][B];
+        #pragma unroll
+        for(unsigned int r = 0; r < B; r++)
+            #pragma unroll
+            for(unsigned int c = 0; c < B; c++)
+                A[r][c] = Ax[(r * B + c) * stride];
+
+        #pragma unroll
+        for(unsigned int c = 0; c < B; c++){
+            const IndexType col = block_col * B + c;
+            if (col < num_cols){
+                #pragma unroll
+                for(unsigned int k = 0; k < NUMVECTORS; k++){
+                    const ValueType x_jk = fetch_x<UseCache>(col + k * num_cols, x);
+                    #pragma unroll
+                    for(unsigned int r = 0; r < B; r++)
+                        sum[r][k] += A[r][c] * x_jk;
+                }
+            }
+        }
+
+        Aj += stride;
+        Ax += B * B * stride;
+    }
+
+    #pragma unroll
+    for(unsigned int r = 0; r < B; r++){
+        const IndexType row = block_row * B + r;
+        if (row < num_rows){
+            #pragma unroll
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                y[row + k * num_rows] += sum[r][k];
+        }
+    }
+}
+
+// largest number of partial sums a block ELL thread keeps in registers
+#define BELL_MAX_ACCUMULATORS 64
+
+template <typename IndexType, typename ValueType, unsigned int B>
+void __spmm_bell_device(const bell_matrix<IndexType,ValueType>& d_bell, 
+                        const ValueType * d_x, 
+                              ValueType * d_y,
+                              IndexType NUMVECTORS)
+{
+    const unsigned int BLOCK_SIZE = 128;
+    const dim3 grid = make_large_grid(d_bell.num_block_rows, BLOCK_SIZE);
+
+    // vectors per launch: B rows of sums for each must fit the register budget
+    unsigned int VECBLOCK = 32;
+    while (VECBLOCK > 2 && (VECBLOCK > NUMVECTORS || B * VECBLOCK > BELL_MAX_ACCUMULATORS))
+        VECBLOCK /= 2;
+
+    for (unsigned int vec=0; vec< NUMVECTORS; vec+=VECBLOCK){
+        const ValueType * x = d_x + vec*d_bell.num_cols;
+              ValueType * y = d_y + vec*d_bell.num_rows;
+
+        switch (VECBLOCK){
+        case 2:
+            spmm_bell_kernel<IndexType,ValueType,B,2,false> <<<grid, BLOCK_SIZE>>>
+            (d_bell.num_rows, d_bell.num_cols, d_bell.num_block_rows, d_bell.num_blocks_per_row, d_bell.stride, d_bell.Aj, d_bell.Ax, x, y);
+            break;
+        case 4:
+            spmm_bell_kernel<IndexType,ValueType,B,4,false> <<<grid, BLOCK_SIZE>>>
+            (d_bell.num_rows, d_bell.num_cols, d_bell.num_block_rows, d_bell.num_blocks_per_row, d_bell.stride, d_bell.Aj, d_bell.Ax, x, y);
+            break;
+        case 8:
+            spmm_bell_kernel<IndexType,ValueType,B,8,false> <<<grid, BLOCK_SIZE>>>
+            (d_bell.num_rows, d_bell.num_cols, d_bell.num_block_rows, d_bell.num_blocks_per_row, d_bell.stride, d_bell.Aj, d_bell.Ax, x, y);
+            break;
+        case 16:
+            spmm_bell_kernel<IndexType,ValueType,B,16,false> <<<grid, BLOCK_SIZE>>>
+            (d_bell.num_rows, d_bell.num_cols, d_bell.num_block_rows, d_bell.num_blocks_per_row, d_bell.stride, d_bell.Aj, d_bell.Ax, x, y);
+            break;
+        case 32:
+            spmm_bell_kernel<IndexType,ValueType,B,32,false> <<<grid, BLOCK_SIZE>>>
+            (d_bell.num_rows, d_bell.num_cols, d_bell.num_block_rows, d_bell.num_blocks_per_row, d_bell.stride, d_bell.Aj, d_bell.Ax, x, y);
+            break;
+        }
+    }
+}
+
+template <typename IndexType, typename ValueType>
+void spmm_bell_device(const bell_matrix<IndexType,ValueType>& d_bell, 
+                      const ValueType * d_x, 
+                            ValueType * d_y,
+                            IndexType NUMVECTORS,
+                            IndexType VECBLOCK)
+{
+    // the vectors are split into register-sized launches below instead
+    switch (d_bell.block_size){
+    case 2: __spmm_bell_device<IndexType,ValueType,2>(d_bell, d_x, d_y, NUMVECTORS); break;
+    case 3: __spmm_bell_device<IndexType,ValueType,3>(d_bell, d_x, d_y, NUMVECTORS); break;
+    case 4: __spmm_bell_device<IndexType,ValueType,4>(d_bell, d_x, d_y, NUMVECTORS); break;
+    case 6: __spmm_bell_device<IndexType,ValueType,6>(d_bell, d_x, d_y, NUMVECTORS); break;
+    default:
+        printf("Unsupported block size %d\n", (int) d_bell.block_size);
+        exit(1);
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ *  Copyright NVIDIA Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//! CPU SpMM kernels for COO matrices sorted along a Hilbert curve
+// Every thread takes an equal stretch of entries, i.e. a compact run of
+// tiles along the curve, so the parts of x and y it touches stay in cache.
+// Sums go to private y tiles, one per tile row the stretch reaches, and are
+// added to y (atomically, as stretches of different threads may share a tile
+// row) once, at the end of the stretch.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "sparse_formats.h"
+#include "parallel.h"
+
+// add the nonzero sums of a private y tile to y
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS>
+void __hilbert_flush_tile(const IndexType first_row,
+                          const IndexType tile_rows,
+                          const IndexType num_rows,
+                          const ValueType * y_tile,
+                                ValueType * y)
+{
+    for(IndexType r = 0; r < tile_rows; r++){
+        for(unsigned int k = 0; k < NUMVECTORS; k++){
+            const ValueType sum = y_tile[r * NUMVECTORS + k];
+            if(sum != 0){
+                #pragma omp atomic
+                y[first_row + r + k * num_rows] += sum;
+            }
+        }
+    }
+}
+
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS>
+void __spmm_hilbert_coo_host(const hilbert_coo_matrix<IndexType,ValueType>& coo,
+                             const ValueType * x,
+                                   ValueType * y)
+{
+    const IndexType tile_size = coo.tile_size;
+
+    IndexType lg_tile = 0;
+    while(((IndexType) 1 << lg_tile) < tile_size)
+        lg_tile++;
+
+    const IndexType num_tile_rows = (coo.num_rows + tile_size - 1) >> lg_tile;
+
+    #pragma omp parallel
+    {
+        const int num_threads = host_team_size();
+        const int t = host_thread_num();
+        const IndexType begin = (IndexType) (((unsigned long long) coo.num_nonzeros *  t     ) / num_threads);
+        const IndexType end   = (IndexType) (((unsigned long long) coo.num_nonzeros * (t + 1)) / num_threads);
+
+        // partial sums of each tile row the stretch reaches, allocated on first
+        // use, the vectors of a row side by side
+        std::vector< std::vector<ValueType> > y_tiles(num_tile_rows);
+        IndexType   tile_row = num_tile_rows;
+        ValueType * y_tile   = NULL;
+
+        for(IndexType n = begin; n < end; n++){
+            const IndexType i = coo.I[n];
+
+            if((i >> lg_tile) != tile_row){
+                tile_row = i >> lg_tile;
+                if(y_tiles[tile_row].empty())
+                    y_tiles[tile_row].resize((size_t) tile_size * NUMVECTORS, 0);
+                y_tile = &y_tiles[tile_row][0];
+            }
+
+            const IndexType r    = i & (tile_size - 1);
+            const ValueType A_ij = coo.V[n];
+            const IndexType j    = coo.J[n];
+            for(unsigned int k = 0; k < NUMVECTORS; k++)
+                y_tile[r * NUMVECTORS + k] += A_ij * x[j + k * coo.num_cols];
+        }
+
+        for(IndexType tr = 0; tr < num_tile_rows; tr++){
+            if(y_tiles[tr].empty())
+                continue;
+            const IndexType first_row = tr << lg_tile;
+            const IndexType tile_rows = std::min(tile_size, coo.num_rows - first_row);
+            __hilbert_flush_tile<IndexType,ValueType,NUMVECTORS>(first_row, tile_rows, coo.num_rows, &y_tiles[tr][0], y);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Y += A*X on the host for NUMVECTORS vectors of a Hilbert-ordered COO matrix
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void spmm_hilbert_coo_host(const hilbert_coo_matrix<IndexType,ValueType>& coo,
+                           const ValueType * x,
+                                 ValueType * y,
+                                 IndexType NUMVECTORS)
+{
+    switch (NUMVECTORS){
+    case 2:  __spmm_hilbert_coo_host<IndexType,ValueType,2>(coo, x, y);  break;
+    case 4:  __spmm_hilbert_coo_host<IndexType,ValueType,4>(coo, x, y);  break;
+    case 8:  __spmm_hilbert_coo_host<IndexType,ValueType,8>(coo, x, y);  break;
+    case 16: __spmm_hilbert_coo_host<IndexType,ValueType,16>(coo, x, y); break;
+    case 32: __spmm_hilbert_coo_host<IndexType,ValueType,32>(coo, x, y); break;
+    default:
+        printf("Unsupported number of vectors %d\n", (int) NUMVECTORS);
+        exit(1);
+    }
+}
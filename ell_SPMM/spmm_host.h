@@ -62,3 +62,45 @@ void spmv_csr_serial_host(const csr_matrix<IndexType, ValueType>& csr,
 }
 
 
+template <typename IndexType, typename ValueType, unsigned int NUMVECTORS>
+void __spmm_csr_host(const csr_matrix<IndexType, ValueType>& csr,
+                     const ValueType * x,
+                           ValueType * y)
+{
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (IndexType i = 0; i < csr.num_rows; i++){
+        ValueType sum[NUMVECTORS];
+        for (unsigned int k = 0; k < NUMVECTORS; k++)
+            sum[k] = y[i + k * csr.num_rows];
+        for (IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++) {
+            const IndexType j    = csr.Aj[jj];  //column index
+            const ValueType A_ij = csr.Ax[jj];
+            for (unsigned int k = 0; k < NUMVECTORS; k++)
+                sum[k] += A_ij * x[j + k * csr.num_cols];
+        }
+        for (unsigned int k = 0; k < NUMVECTORS; k++)
+            y[i + k * csr.num_rows] = sum[k];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Compute Y += A*X for NUMVECTORS column vectors on all host threads,
+//! one row at a time; the baseline for the host formats
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType>
+void spmm_csr_host(const csr_matrix<IndexType, ValueType>& csr,
+                   const ValueType * x,
+                         ValueType * y,
+                         IndexType NUMVECTORS)
+{
+    switch (NUMVECTORS){
+    case 2:  __spmm_csr_host<IndexType,ValueType,2>(csr, x, y);  break;
+    case 4:  __spmm_csr_host<IndexType,ValueType,4>(csr, x, y);  break;
+    case 8:  __spmm_csr_host<IndexType,ValueType,8>(csr, x, y);  break;
+    case 16: __spmm_csr_host<IndexType,ValueType,16>(csr, x, y); break;
+    case 32: __spmm_csr_host<IndexType,ValueType,32>(csr, x, y); break;
+    default:
+        printf("Unsupported number of vectors %d\n", (int) NUMVECTORS);
+        exit(1);
+    }
+}
@@ -21,43 +21,81 @@
 #include <limits>
 #include <cmath>
 #include "mem.h"
+#include "bfloat16.h"
+#include "sparse_conversions.h"
 #include "spmm_host.h"
 #include "spmm_ell_device.cu.h"
 
+// relative rounding error of a type used to store matrix values
 template <typename T>
-T maximum_relative_error(const T * A, const T * B, const size_t N)
+double storage_epsilon() { return std::numeric_limits<T>::epsilon(); }
+
+template <>
+inline double storage_epsilon<bfloat16>() { return 1.0 / 128; }
+
+// |y| + |A|*|x| for every row of every vector: the scale of the rounding
+// error a correct kernel can make in each sum of y += A*x
+template <typename IndexType, typename ValueType>
+void spmm_csr_magnitude_host(const csr_matrix<IndexType,ValueType>& csr, const ValueType * x, const ValueType * y, ValueType * m, const IndexType NUMVECTORS)
+{
+    for(IndexType j = 0; j < NUMVECTORS; j++){
+        for(IndexType i = 0; i < csr.num_rows; i++){
+            ValueType sum = std::abs(y[j*csr.num_rows+i]);
+            for(IndexType jj = csr.Ap[i]; jj < csr.Ap[i+1]; jj++)
+                sum += std::abs(csr.Ax[jj]) * std::abs(x[j*csr.num_cols+csr.Aj[jj]]);
+            m[j*csr.num_rows+i] = sum;
+        }
+    }
+}
+
+// error of B against A relative to the magnitudes M of the sums; errors
+// above 'tolerance' are counted
+template <typename T>
+T maximum_relative_error(const T * A, const T * B, const T * M, const size_t N, const size_t num_vectors, const T tolerance)
 {
     T max_error = 0;
-    float max_absolute_error;
+    T max_absolute_error = 0;
     int number_of_errors=0;
     int vector=0;
     int location=0;
-    T eps = std::sqrt( std::numeric_limits<T>::epsilon() );
     
-    for (size_t j=0; j<NUMVECTORS ; j++){
+    for (size_t j=0; j<num_vectors ; j++){
     	for(size_t i = 0; i < N; i++)
     	{
        	const T a = A[j*N+i];
         	const T b = B[j*N+i];
         	const T error = std::abs(a - b);
         	if (error != 0){
-                     if ( error/(std::abs(a) + std::abs(b) + eps) > 5 * std::sqrt( std::numeric_limits<T>::epsilon() ) )number_of_errors++;
-            		max_error = std::max(max_error, error/(std::abs(a) + std::abs(b) + eps) );
-			if (error/(std::abs(a) + std::abs(b) + eps) == max_error) {max_absolute_error=std::abs(a - b) ; vector=j; location=i;}
+        		const T relative_error = error / (M[j*N+i] + std::numeric_limits<T>::min());
+                     if ( relative_error > tolerance )number_of_errors++;
+            		max_error = std::max(max_error, relative_error);
+			if (relative_error == max_error) {max_absolute_error=error ; vector=j; location=i;}
         	}
     	}
     }
     printf("number of errors = %d\n", number_of_errors);
-    printf("location of maximum error= %d in vector %d error %f\n", location, vector, max_absolute_error);
+    printf("location of maximum error= %d in vector %d error %g\n", location, vector, (double) max_absolute_error);
     return max_error;
 }
 
 
-template <typename IndexType, typename ValueType>
-void test_spmm_ell_kernel(const csr_matrix<IndexType,ValueType>& csr)
+////////////////////////////////////////////////////////////////////////////////
+//! Check an SpMM on the device against CSR SpMV on the host
+// Works for any matrix type with a copy_matrix_to_device and
+// delete_device_matrix overload.  'mtx' may store its values in a narrower
+// type than the vectors; the reference uses the values of 'csr', so the error
+// reported is that of the whole kernel, value rounding included.  y is
+// compared in the row order of 'csr', so kernels that reorder rows must
+// write each result back to its original row.  Errors are relative to
+// |y| + |A|*|x| and flagged above twice the worst case: one epsilon of the
+// stored values for their rounding, plus one epsilon of ValueType for each
+// addition in the longest row.
+////////////////////////////////////////////////////////////////////////////////
+template <typename IndexType, typename ValueType, typename Matrix, typename SpMM>
+ValueType test_spmm_kernel(const csr_matrix<IndexType,ValueType>& csr, const Matrix& mtx, SpMM spmm, const char * method_name, const IndexType NUMVECTORS = MAX_NUMVECTORS)
 {
 
-    printf("\n####  Testing ELL SpMM Kernel ####\n");
+    printf("\n####  Testing %s SpMM Kernel ####\n", method_name);
    
     const IndexType num_rows = csr.num_rows;
     const IndexType num_cols = csr.num_cols;
@@ -74,21 +112,10 @@ void test_spmm_ell_kernel(const csr_matrix<IndexType,ValueType>& csr)
 	    for(IndexType i = 0; i < num_rows; i++)
        	 y_host[j*num_rows+i] = rand() / (RAND_MAX + 1.0);
 
-   
-    printf("Creating ELL_matrix.....\n");
-    IndexType max_cols_per_row = static_cast<IndexType>( (3 * csr.num_nonzeros) / csr.num_rows + 1 );//khalid: equation is for dia
-    ell_matrix<IndexType,ValueType> ell = csr_to_ell<IndexType,ValueType>(csr, max_cols_per_row);
-    if (ell.num_nonzeros == 0 && csr.num_nonzeros != 0){
-       printf(" num_cols_per_row (%d) excedes limit (%d)\n", ell.num_cols_per_row, max_cols_per_row);
-       return;
-    }
-    printf(" found %d num_cols_per_row\n", ell.num_cols_per_row);
-    printf("done\n");
- 
 
-   printf("###   Checking the correctness of ELL kernel   ###\n");    
+   printf("###   Checking the correctness of %s kernel   ###\n", method_name);    
    // transfer matrices from host to destination location
-   ell_matrix<IndexType,ValueType> sm2_loc2 = copy_matrix_to_device(ell);
+   Matrix sm2_loc2 = copy_matrix_to_device(mtx);
    printf("Finished copying the matrix to device memory...\n");
     
    // create vectors in appropriate locations
@@ -100,13 +127,15 @@ void test_spmm_ell_kernel(const csr_matrix<IndexType,ValueType>& csr)
    
    
 
+   ValueType * y_magnitude = new_host_array<ValueType>(num_rows* NUMVECTORS );
+   spmm_csr_magnitude_host(csr, x_host, y_host, y_magnitude, NUMVECTORS);
+
    printf("Calling CSR kernel on host....\n");
    for(IndexType j = 0; j < NUMVECTORS ; j++)
    	spmv_csr_serial_host<IndexType,ValueType>(csr, x_loc1 + j*num_cols, y_loc1 + j*num_rows);
    printf("done...\n");
-   printf("Calling ELL kernel on device.....\n");
-   //spmm_ell_device(sm2_loc2,  x_loc2, y_loc2);
-   spmm_ell_tex_device(sm2_loc2,  x_loc2, y_loc2);
+   printf("Calling %s kernel on device.....\n", method_name);
+   spmm(sm2_loc2, x_loc2, y_loc2, NUMVECTORS, NUMVECTORS);
    printf("done...\n ");
 
    
@@ -114,22 +143,25 @@ void test_spmm_ell_kernel(const csr_matrix<IndexType,ValueType>& csr)
    ValueType * y_sm1_result = copy_array(y_loc1, num_rows*NUMVECTORS , HOST_MEMORY, HOST_MEMORY);
    ValueType * y_sm2_result = copy_array(y_loc2, num_rows*NUMVECTORS , DEVICE_MEMORY, HOST_MEMORY);
 
-   ValueType max_error = maximum_relative_error(y_sm1_result, y_sm2_result, num_rows);
-   printf("[max error %9f]", max_error);
+   const double max_row_length = csr_max_row_length(csr.num_rows, csr.Ap);
+   const ValueType tolerance = (ValueType) (2 * (storage_epsilon<typename Matrix::value_type>() + (max_row_length + 1) * storage_epsilon<ValueType>()));
+   ValueType max_error = maximum_relative_error(y_sm1_result, y_sm2_result, y_magnitude, num_rows, NUMVECTORS, tolerance);
+   printf("[max error %9g]", (double) max_error);
     
-    if ( max_error > 5 * std::sqrt( std::numeric_limits<ValueType>::epsilon() ) )
+    if ( max_error > tolerance )
        printf(" POSSIBLE FAILURE");
     printf("\n");    
     // cleanup
     delete_device_matrix(sm2_loc2);
-    delete_host_matrix(ell);
     delete_host_array(x_host);
     delete_host_array(y_host);
+    delete_host_array(y_magnitude);
     delete_array(x_loc1, HOST_MEMORY);
     delete_array(x_loc2, DEVICE_MEMORY);
     delete_array(y_loc1, HOST_MEMORY);
     delete_array(y_loc2, DEVICE_MEMORY);
     delete_host_array(y_sm1_result);
     delete_host_array(y_sm2_result);
-}
 
+    return max_error;
+}
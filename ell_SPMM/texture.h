@@ -37,23 +37,23 @@ void unbind_x(const double * x)
 {   (cudaUnbindTexture(tex_x_double)); }
 // Note: x is unused, but distinguishes the two functions
 
-template <bool UseCache>
-__inline__ __device__ float fetch_x(const int& i, const float * x)
+template <bool UseCache, typename IndexType>
+__inline__ __device__ float fetch_x(const IndexType& i, const float * x)
 {
     if (UseCache)
-        return tex1Dfetch(tex_x_float, i);
+        return tex1Dfetch(tex_x_float, (int) i);   // textures take 32-bit offsets
     else
         return x[i];
 }
 
-template <bool UseCache>
-__inline__ __device__ double fetch_x(const int& i, const double * x)
+template <bool UseCache, typename IndexType>
+__inline__ __device__ double fetch_x(const IndexType& i, const double * x)
 {
 #if __CUDA_ARCH__ >= 130
     // double requires Compute Capability 1.3 or greater
     if (UseCache)
     {
-        int2 v = tex1Dfetch(tex_x_double, i);
+        int2 v = tex1Dfetch(tex_x_double, (int) i);
         return __hiloint2double(v.y, v.x);
     }
     else
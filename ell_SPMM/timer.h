@@ -18,6 +18,7 @@
 // A simple timer class
 
 #include <cuda.h>
+#include <sys/time.h>
 
 class timer
 {
@@ -53,4 +54,30 @@ public:
 };
 
 
+// Wall-clock timer for host-side work (file loading, format conversion)
+class host_timer
+{
+    double start;
+
+    static double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1e-6 * tv.tv_usec;
+    }
+
+public:
+    host_timer()
+    {
+        start = now();
+    }
 
+    float milliseconds_elapsed()
+    {
+        return 1000.0 * (now() - start);
+    }
+    float seconds_elapsed()
+    {
+        return now() - start;
+    }
+};
@@ -127,6 +127,31 @@ __device__ void memcpy_device(ValueType * dest, const ValueType * src, const Ind
 
 
 
+/*
+ *  Atomic *address += val for float and double.  Double atomicAdd is native
+ *  from Compute Capability 6.0; older devices use a compare-and-swap loop.
+ */
+__inline__ __device__ float atomic_add(float * address, const float val)
+{
+    return atomicAdd(address, val);
+}
+
+__inline__ __device__ double atomic_add(double * address, const double val)
+{
+#if __CUDA_ARCH__ >= 600
+    return atomicAdd(address, val);
+#else
+    unsigned long long int * address_as_ull = (unsigned long long int *) address;
+    unsigned long long int old = *address_as_ull, assumed;
+    do {
+        assumed = old;
+        old = atomicCAS(address_as_ull, assumed, __double_as_longlong(val + __longlong_as_double(assumed)));
+    } while (assumed != old);
+    return __longlong_as_double(old);
+#endif
+}
+
+
 /*
  *  Gather from src into dest according to map.  Equivalent to the following C
  *